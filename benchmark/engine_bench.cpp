@@ -0,0 +1,273 @@
+/**
+ * Benchmark suite for the engine: every division scheme and print mode over a grid of
+ * thread counts and ranges.
+ *
+ * Each configuration runs a few warmup rounds and then the timed repeats, with the program's
+ * own output sent to the null device. The median and p95 wall time are reported per
+ * configuration, along with the speedup and parallel efficiency against the single-threaded
+ * median for the same scheme, mode, range and affinity. Comparing --affinity=none,compact,scatter
+ * on a multi-socket host shows what pinning the workers and keeping their memory on their own
+ * node is worth there.
+ *
+ * Usage: engine_bench [--threads=1,2,4] [--ranges=1000,1000000] [--warmup=1] [--repeats=5]
+ *                     [--affinity=none,compact,scatter] [--max-seconds=10]
+ *                     [--output=results.csv|results.json]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define close _close
+#define open _open
+const char* NULL_DEVICE = "NUL";
+#else
+#include <unistd.h>
+const char* NULL_DEVICE = "/dev/null";
+#endif
+
+#include "../common/engine.h"
+
+struct BenchOptions {
+    std::vector<int> threads;
+    std::vector<uint64_t> ranges = {1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+    int warmup = 1;
+    int repeats = 5;
+    std::vector<AffinityMode> affinities = {AffinityMode::None};
+    // once a run of a scheme takes longer than this, its larger ranges are skipped
+    double maxSeconds = 10;
+    std::string outputPath;
+};
+
+struct BenchResult {
+    const char* print;
+    const char* division;
+    const char* affinity;
+    int threads;
+    uint64_t y;
+    int repeats;
+    double medianSeconds;
+    double p95Seconds;
+    double minSeconds;
+    double speedup;
+    double efficiency;
+};
+
+// Sends everything the engine prints to the null device until destroyed
+class SilencedStdout {
+public:
+    SilencedStdout() {
+        std::cout.flush();
+        std::fflush(stdout);
+        saved = dup(1);
+        int nullFd = open(NULL_DEVICE, O_WRONLY);
+        dup2(nullFd, 1);
+        close(nullFd);
+    }
+
+    ~SilencedStdout() {
+        std::cout.flush();
+        std::fflush(stdout);
+        dup2(saved, 1);
+        close(saved);
+    }
+
+private:
+    int saved;
+};
+
+template <class List>
+bool parseList(const std::string& value, List& list) {
+    list.clear();
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!isNumValid(item)) return false;
+        list.push_back(static_cast<typename List::value_type>(std::stoull(item)));
+    }
+    return !list.empty();
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        std::string value = argument.substr(argument.find('=') + 1);
+
+        if (argument.rfind("--threads=", 0) == 0) {
+            if (!parseList(value, options.threads)) return false;
+        } else if (argument.rfind("--ranges=", 0) == 0) {
+            if (!parseList(value, options.ranges)) return false;
+        } else if (argument.rfind("--affinity=", 0) == 0) {
+            options.affinities.clear();
+            std::stringstream stream(value);
+            std::string item;
+            while (std::getline(stream, item, ',')) {
+                AffinityMode affinity;
+                if (!parseAffinity(item, affinity)) {
+                    std::cerr << "Error: Unknown affinity " << item << "!" << std::endl;
+                    return false;
+                }
+                options.affinities.push_back(affinity);
+            }
+            if (options.affinities.empty()) return false;
+        } else if (argument.rfind("--warmup=", 0) == 0 && isNumValid(value)) {
+            options.warmup = std::stoi(value);
+        } else if (argument.rfind("--repeats=", 0) == 0 && isNumValid(value)) {
+            options.repeats = std::max(std::stoi(value), 1);
+        } else if (argument.rfind("--max-seconds=", 0) == 0) {
+            try {
+                options.maxSeconds = std::stod(value);
+            } catch (const std::exception&) {
+                std::cerr << "Error: Invalid input!" << std::endl;
+                return false;
+            }
+        } else if (argument.rfind("--output=", 0) == 0) {
+            options.outputPath = value;
+        } else {
+            std::cerr << "Error: Unknown option " << argument << "!" << std::endl;
+            return false;
+        }
+    }
+
+    if (options.threads.empty()) {
+        // powers of two up to the number of cores, plus the core count itself
+        int cores = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+        for (int x = 1; x < cores; x *= 2) options.threads.push_back(x);
+        options.threads.push_back(cores);
+    }
+    if (std::find(options.threads.begin(), options.threads.end(), 1) == options.threads.end()) {
+        // speedup and efficiency are relative to one thread
+        options.threads.insert(options.threads.begin(), 1);
+    }
+    return true;
+}
+
+// Value at the given percentile of sorted samples, nearest-rank
+double percentile(const std::vector<double>& sorted, double fraction) {
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+template <class PrintPolicy, class DivisionPolicy>
+double timeRun(const Config& config) {
+    SilencedStdout silenced;
+    auto start = std::chrono::steady_clock::now();
+    runSearch<PrintPolicy, DivisionPolicy>(config);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <class PrintPolicy, class DivisionPolicy>
+void benchScheme(const BenchOptions& options, AffinityMode affinity, std::vector<BenchResult>& results) {
+    for (uint64_t y : options.ranges) {
+        double singleThreadMedian = 0;
+        bool overBudget = false;
+
+        for (int x : options.threads) {
+            Config config;
+            config.xNumThreads = x;
+            config.yNumber = y;
+            config.affinity = affinity;
+
+            for (int i = 0; i < options.warmup; ++i) {
+                timeRun<PrintPolicy, DivisionPolicy>(config);
+            }
+
+            std::vector<double> samples;
+            for (int i = 0; i < options.repeats; ++i) {
+                samples.push_back(timeRun<PrintPolicy, DivisionPolicy>(config));
+                if (samples.back() > options.maxSeconds) overBudget = true;
+                if (overBudget) break;
+            }
+            std::sort(samples.begin(), samples.end());
+
+            double median = percentile(samples, 0.5);
+            if (x == 1) singleThreadMedian = median;
+            double speedup = singleThreadMedian / median;
+
+            BenchResult result = {PrintPolicy::NAME, DivisionPolicy::NAME, affinityName(affinity), x, y,
+                                  static_cast<int>(samples.size()), median, percentile(samples, 0.95), samples.front(), speedup, speedup / x};
+            results.push_back(result);
+
+            std::cout << std::setfill(' ') << std::left << std::setw(11) << result.print << std::setw(10) << result.division
+                      << std::setw(9) << result.affinity << std::right << std::setw(8) << x << std::setw(12) << y
+                      << std::fixed << std::setprecision(6) << std::setw(12) << median
+                      << std::setw(12) << result.p95Seconds
+                      << std::setprecision(2) << std::setw(9) << speedup << "x"
+                      << std::setw(10) << result.efficiency * 100 << "%" << std::endl;
+
+            if (overBudget) break;
+        }
+
+        if (overBudget) {
+            std::cout << "Skipping larger ranges for " << PrintPolicy::NAME << "/" << DivisionPolicy::NAME
+                      << "/" << affinityName(affinity) << ", a run took over " << options.maxSeconds << "s" << std::endl;
+            return;
+        }
+    }
+}
+
+void writeResults(const std::string& path, const std::vector<BenchResult>& results) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Error: Could not write results to " << path << "!" << std::endl;
+        return;
+    }
+
+    bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    if (csv) {
+        out << "print,division,affinity,threads,y,repeats,medianSeconds,p95Seconds,minSeconds,speedup,efficiency\n";
+    } else {
+        out << "[\n";
+    }
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        if (csv) {
+            out << r.print << "," << r.division << "," << r.affinity << "," << r.threads << "," << r.y << "," << r.repeats << ","
+                << r.medianSeconds << "," << r.p95Seconds << "," << r.minSeconds << ","
+                << r.speedup << "," << r.efficiency << "\n";
+        } else {
+            out << "  {\"print\": \"" << r.print << "\", \"division\": \"" << r.division
+                << "\", \"affinity\": \"" << r.affinity << "\", \"threads\": " << r.threads << ", \"y\": " << r.y << ", \"repeats\": " << r.repeats
+                << ", \"medianSeconds\": " << r.medianSeconds << ", \"p95Seconds\": " << r.p95Seconds
+                << ", \"minSeconds\": " << r.minSeconds << ", \"speedup\": " << r.speedup
+                << ", \"efficiency\": " << r.efficiency << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+
+    if (!csv) out << "]\n";
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) return 1;
+
+    std::cout << std::left << std::setw(11) << "print" << std::setw(10) << "division"
+              << std::setw(9) << "affinity" << std::right << std::setw(8) << "threads" << std::setw(12) << "y"
+              << std::setw(12) << "median s" << std::setw(12) << "p95 s"
+              << std::setw(10) << "speedup" << std::setw(11) << "efficiency" << std::endl;
+
+    std::vector<BenchResult> results;
+    for (AffinityMode affinity : options.affinities) {
+        benchScheme<ImmediatePrint, StraightDivision>(options, affinity, results);
+        benchScheme<DeferredPrint, StraightDivision>(options, affinity, results);
+        benchScheme<ImmediatePrint, LinearDivision>(options, affinity, results);
+        benchScheme<DeferredPrint, LinearDivision>(options, affinity, results);
+    }
+
+    if (!options.outputPath.empty()) writeResults(options.outputPath, results);
+    return 0;
+}
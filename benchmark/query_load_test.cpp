@@ -0,0 +1,157 @@
+/**
+ * Load test for the prime query server.
+ *
+ * Opens the given number of connections, each sending requests back to back with a random mix
+ * of primes-in-range, count-in-range and is-prime queries, and reports the request latency
+ * percentiles and the overall throughput. With --verify every answer is checked locally.
+ *
+ * Usage: query_load_test [--socket=primesearch.sock] [--connections=4] [--requests=10000]
+ *                        [--max=1000000000] [--width=1000] [--verify]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/primality.h"
+#include "../common/query_protocol.h"
+
+struct LoadOptions {
+    std::string socketPath = "primesearch.sock";
+    int connections = 4;
+    int requests = 10000;
+    uint64_t maxNumber = 1000000000;
+    uint64_t width = 1000;
+    bool verify = false;
+};
+
+struct ConnectionResult {
+    std::vector<double> latencies; // microseconds
+    uint64_t errors = 0;
+    uint64_t mismatches = 0;
+};
+
+bool parseOptions(int argc, char* argv[], LoadOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        std::string value = argument.substr(argument.find('=') + 1);
+
+        if (argument.rfind("--socket=", 0) == 0) {
+            options.socketPath = value;
+        } else if (argument.rfind("--connections=", 0) == 0) {
+            options.connections = std::max(std::stoi(value), 1);
+        } else if (argument.rfind("--requests=", 0) == 0) {
+            options.requests = std::max(std::stoi(value), 1);
+        } else if (argument.rfind("--max=", 0) == 0) {
+            options.maxNumber = std::stoull(value);
+        } else if (argument.rfind("--width=", 0) == 0) {
+            options.width = std::max<uint64_t>(std::stoull(value), 1);
+        } else if (argument == "--verify") {
+            options.verify = true;
+        } else {
+            std::cerr << "Error: Unknown option " << argument << "!" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check an answer against local trial division / Miller-Rabin
+bool answerIsCorrect(const QueryRequest& request, const QueryResponseHeader& response,
+                     const std::vector<uint64_t>& primes) {
+    if (request.type == QUERY_IS_PRIME) return response.count == (isPrime(request.a) ? 1u : 0u);
+
+    std::vector<uint64_t> expected;
+    for (uint64_t n = request.a; n <= request.b && n >= request.a; ++n) {
+        if (isPrime(n)) expected.push_back(n);
+    }
+    if (request.type == QUERY_COUNT) return response.count == expected.size();
+    return primes == expected;
+}
+
+void runConnection(const LoadOptions& options, int id, ConnectionResult& result) {
+    int fd = connectToServer(options.socketPath);
+    if (fd < 0) {
+        result.errors = options.requests;
+        return;
+    }
+
+    std::mt19937_64 random(12345 + id);
+    std::uniform_int_distribution<uint64_t> numbers(1, options.maxNumber);
+    std::vector<uint64_t> primes;
+    result.latencies.reserve(options.requests);
+
+    for (int i = 0; i < options.requests; ++i) {
+        QueryRequest request = {static_cast<uint32_t>(QUERY_PRIMES + i % 3), 0, numbers(random), 0};
+        request.b = request.a + options.width - 1;
+
+        auto start = std::chrono::steady_clock::now();
+        QueryResponseHeader response;
+        bool ok = writeFully(fd, &request, sizeof(request)) && readFully(fd, &response, sizeof(response));
+        if (ok && request.type == QUERY_PRIMES) {
+            primes.resize(response.count);
+            ok = readFully(fd, primes.data(), primes.size() * sizeof(uint64_t));
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        if (!ok || response.status != STATUS_OK) {
+            ++result.errors;
+            if (!ok) break;
+            continue;
+        }
+        result.latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+
+        if (options.verify && !answerIsCorrect(request, response, primes)) ++result.mismatches;
+    }
+    ::close(fd);
+}
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[rank];
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    if (!parseOptions(argc, argv, options)) return 1;
+
+    std::vector<ConnectionResult> results(options.connections);
+    std::vector<std::thread> clients;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.connections; ++i) {
+        clients.emplace_back(runConnection, std::cref(options), i, std::ref(results[i]));
+    }
+    for (auto& t : clients) t.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<double> latencies;
+    uint64_t errors = 0, mismatches = 0;
+    for (const auto& result : results) {
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        errors += result.errors;
+        mismatches += result.mismatches;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << "Requests: " << latencies.size() << " over " << options.connections << " connections in "
+              << elapsed.count() << "s (" << std::fixed << std::setprecision(0)
+              << latencies.size() / elapsed.count() << " requests/s)" << std::endl;
+    std::cout << std::setprecision(1)
+              << "Latency us: p50 " << percentile(latencies, 0.50)
+              << " | p90 " << percentile(latencies, 0.90)
+              << " | p99 " << percentile(latencies, 0.99)
+              << " | p99.9 " << percentile(latencies, 0.999)
+              << " | max " << (latencies.empty() ? 0 : latencies.back()) << std::endl;
+    std::cout << "Errors: " << errors;
+    if (options.verify) std::cout << " | Wrong answers: " << mismatches;
+    std::cout << std::endl;
+
+    return (errors == 0 && mismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+/**
+ * Microbenchmark for the batch trial division kernels in common/trial_division.h.
+ *
+ * Tests every number in [start, start + count) for primality with each kernel and reports
+ * numbers tested per second, compared with the scalar n % i loop the variations used to run.
+ *
+ * Usage: trial_division_bench [count] [start]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "../common/trial_division.h"
+
+// The original loop: divide by every integer up to sqrt(n)
+bool isPrimeModulo(uint32_t n) {
+    if (n <= 1) return false;
+    for (uint64_t i = 2; i * i <= n; ++i) {
+        if (n % i == 0) return false;
+    }
+    return true;
+}
+
+// Same loop but only over the primes up to sqrt(n)
+bool isPrimeModuloPrimes(uint32_t n) {
+    if (n <= 1) return false;
+    for (uint32_t p : primeMagicTable().primes) {
+        if (static_cast<uint64_t>(p) * p > n) break;
+        if (n % p == 0) return false;
+    }
+    return true;
+}
+
+// The magic number test over the primes up to sqrt(n) with a given kernel
+template <DivisibleByAnyFunction kernel>
+bool isPrimeWithKernel(uint32_t n) {
+    if (n <= 1) return false;
+
+    const PrimeMagicTable& table = primeMagicTable();
+    uint32_t root = static_cast<uint32_t>(std::sqrt(static_cast<double>(n)));
+    while (static_cast<uint64_t>(root) * root > n) --root;
+    size_t count = std::upper_bound(table.primes.begin(), table.primes.end(), root) - table.primes.begin();
+    return !kernel(n, table.magic.data(), count);
+}
+
+struct BenchResult {
+    double numbersPerSecond;
+    uint64_t primesFound;
+};
+
+BenchResult run(bool (*isPrimeFunction)(uint32_t), uint32_t start, uint32_t count) {
+    auto begin = std::chrono::steady_clock::now();
+
+    uint64_t primesFound = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (isPrimeFunction(start + i)) ++primesFound;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return {count / elapsed.count(), primesFound};
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t count = (argc > 1) ? static_cast<uint32_t>(std::stoul(argv[1])) : 200000;
+    uint32_t start = (argc > 2) ? static_cast<uint32_t>(std::stoul(argv[2])) : 2000000000;
+    if (static_cast<uint64_t>(start) + count > UINT32_MAX) {
+        std::cerr << "Error: range must stay below 2^32!" << std::endl;
+        return 1;
+    }
+
+    // build the tables before timing anything
+    primeMagicTable();
+
+    struct Kernel {
+        std::string name;
+        bool (*isPrimeFunction)(uint32_t);
+    };
+    std::vector<Kernel> kernels = {
+        {"n % i, every i", isPrimeModulo},
+        {"n % p, primes", isPrimeModuloPrimes},
+        {"magic scalar", isPrimeWithKernel<divisibleByAnyScalar>},
+    };
+#ifdef TRIAL_DIVISION_X86
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({"magic avx2", isPrimeWithKernel<divisibleByAnyAvx2>});
+    }
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+        kernels.push_back({"magic avx512", isPrimeWithKernel<divisibleByAnyAvx512>});
+    }
+#endif
+
+    std::cout << "Testing " << count << " numbers from " << start
+              << " (runtime dispatch picks " << divisibleByAnyName() << ")" << std::endl;
+    std::cout << std::left << std::setw(18) << "kernel" << std::right << std::setw(16) << "numbers/s"
+              << std::setw(10) << "speedup" << std::setw(10) << "primes" << std::endl;
+
+    double baseline = 0;
+    uint64_t expectedPrimes = 0;
+    for (const auto& kernel : kernels) {
+        BenchResult result = run(kernel.isPrimeFunction, start, count);
+        if (baseline == 0) {
+            baseline = result.numbersPerSecond;
+            expectedPrimes = result.primesFound;
+        }
+
+        std::cout << std::left << std::setw(18) << kernel.name << std::right
+                  << std::setw(16) << std::fixed << std::setprecision(0) << result.numbersPerSecond
+                  << std::setw(9) << std::setprecision(2) << result.numbersPerSecond / baseline << "x"
+                  << std::setw(10) << result.primesFound << std::endl;
+
+        if (result.primesFound != expectedPrimes) {
+            std::cerr << "Error: " << kernel.name << " disagrees with n % i!" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,210 @@
+/**
+ * Asynchronous batched stdout writer: one SPSC ring per worker, drained by a single writer thread.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+// Windows has no writev, so write the spans one at a time
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+
+const int STDOUT_FILENO = 1;
+
+inline long long writev(int fd, const iovec* spans, int count) {
+    long long total = 0;
+    for (int i = 0; i < count; ++i) {
+        int written = _write(fd, spans[i].iov_base, static_cast<unsigned int>(spans[i].iov_len));
+        if (written < 0) return total > 0 ? total : -1;
+        total += written;
+        if (static_cast<size_t>(written) < spans[i].iov_len) break;
+    }
+    return total;
+}
+#endif
+
+// Single-producer single-consumer byte ring, one per worker so producers never share a lock.
+// Only the worker a ring belongs to may push to it, never another thread on its behalf.
+class OutputRing {
+public:
+    explicit OutputRing(size_t capacity) : buffer(capacity) {}
+
+    // Producer side: copy a whole line in, waiting for the writer if the ring is full
+    void push(const char* data, size_t length, std::condition_variable& wakeWriter) {
+        size_t writePos = head.load(std::memory_order_relaxed);
+        if (writePos + length - tail.load(std::memory_order_acquire) > buffer.size()) {
+            auto waitStart = std::chrono::steady_clock::now();
+            while (writePos + length - tail.load(std::memory_order_acquire) > buffer.size()) {
+                // back-pressure: hand the CPU to the writer until it has drained some space
+                wakeWriter.notify_one();
+                std::this_thread::yield();
+            }
+            waitedNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - waitStart).count();
+        }
+
+        // the line may wrap around the end of the buffer
+        size_t offset = writePos % buffer.size();
+        size_t first = std::min(length, buffer.size() - offset);
+        std::copy(data, data + first, buffer.begin() + offset);
+        std::copy(data + first, data + length, buffer.begin());
+        head.store(writePos + length, std::memory_order_release);
+
+        // wake the writer early once the ring is half full instead of waiting out the latency
+        if (writePos + length - tail.load(std::memory_order_relaxed) > buffer.size() / 2) {
+            wakeWriter.notify_one();
+        }
+    }
+
+    // Consumer side: the pending bytes as at most two contiguous spans, returns how many
+    int pending(iovec (&spans)[2], size_t& length) const {
+        size_t readPos = tail.load(std::memory_order_relaxed);
+        length = head.load(std::memory_order_acquire) - readPos;
+        if (length == 0) return 0;
+
+        size_t offset = readPos % buffer.size();
+        size_t first = std::min(length, buffer.size() - offset);
+        spans[0] = {const_cast<char*>(buffer.data()) + offset, first};
+        if (first == length) return 1;
+
+        spans[1] = {const_cast<char*>(buffer.data()), length - first};
+        return 2;
+    }
+
+    void release(size_t length) {
+        tail.store(tail.load(std::memory_order_relaxed) + length, std::memory_order_release);
+    }
+
+    // Time the producer spent blocked on a full ring, only read once the producer has stopped
+    long long producerWaitNanos() const { return waitedNanos; }
+
+private:
+    std::vector<char> buffer;
+    long long waitedNanos = 0;
+    alignas(64) std::atomic<size_t> head{0}; // total bytes written by the producer
+    alignas(64) std::atomic<size_t> tail{0}; // total bytes consumed by the writer
+};
+
+// Prints lines from all workers through one writer thread, which drains every ring
+// at least once per maxLatency and writes what it finds in a single batch
+class AsyncWriter {
+public:
+    AsyncWriter(int numProducers, std::chrono::milliseconds maxLatency) : maxLatency(maxLatency) {
+        for (int i = 0; i < numProducers; ++i) {
+            rings.push_back(std::make_unique<OutputRing>(RING_CAPACITY));
+        }
+        writer = std::thread(&AsyncWriter::writerLoop, this);
+    }
+
+    ~AsyncWriter() { stop(); }
+
+    // Drain what is left and stop the writer thread, false if any of the output could not be written
+    bool stop() {
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                stopping = true;
+            }
+            wakeWriter.notify_one();
+            writer.join();
+        }
+        return !writeFailed;
+    }
+
+    // Called only by the producer's own thread, see OutputRing
+    void write(int producer, const char* data, size_t length) {
+        rings[producer]->push(data, length, wakeWriter);
+    }
+
+    long long producerWaitNanos(int producer) const {
+        return rings[producer]->producerWaitNanos();
+    }
+
+private:
+    void writerLoop() {
+        while (true) {
+            bool done;
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wakeWriter.wait_for(lock, maxLatency, [this] { return stopping; });
+                done = stopping;
+            }
+
+            // producers have all finished once stopping is set, so this drains everything
+            drain();
+            if (done) return;
+        }
+    }
+
+    void drain() {
+        std::vector<iovec> spans;
+        std::vector<size_t> lengths(rings.size());
+        for (size_t i = 0; i < rings.size(); ++i) {
+            iovec ringSpans[2];
+            int count = rings[i]->pending(ringSpans, lengths[i]);
+            spans.insert(spans.end(), ringSpans, ringSpans + count);
+        }
+
+        writeSpans(spans);
+        for (size_t i = 0; i < rings.size(); ++i) {
+            if (lengths[i] > 0) rings[i]->release(lengths[i]);
+        }
+    }
+
+    // A write interrupted by a signal is retried. Any other error drops the rest of the output and
+    // is reported by stop(), while the rings are still released so the producers never block on it.
+    void writeSpans(std::vector<iovec>& spans) {
+        if (writeFailed) return;
+        for (size_t first = 0; first < spans.size(); ) {
+            size_t count = std::min(spans.size() - first, static_cast<size_t>(IOV_BATCH));
+            long long written = ::writev(STDOUT_FILENO, spans.data() + first, static_cast<int>(count));
+            if (written < 0 && errno == EINTR) continue;
+            if (written < 0) {
+                writeFailed = true;
+                return;
+            }
+
+            // skip fully written spans and trim a partially written one
+            size_t remaining = static_cast<size_t>(written);
+            while (first < spans.size() && remaining >= spans[first].iov_len) {
+                remaining -= spans[first].iov_len;
+                ++first;
+            }
+            if (remaining > 0) {
+                spans[first].iov_base = static_cast<char*>(spans[first].iov_base) + remaining;
+                spans[first].iov_len -= remaining;
+            }
+        }
+    }
+
+    static constexpr size_t RING_CAPACITY = 1 << 20;
+    static constexpr int IOV_BATCH = 64;
+
+    std::vector<std::unique_ptr<OutputRing>> rings;
+    std::chrono::milliseconds maxLatency;
+    std::thread writer;
+    std::mutex wakeMutex;
+    std::condition_variable wakeWriter;
+    bool stopping = false;
+    // Only touched by the writer thread, and read by stop() once it has joined
+    bool writeFailed = false;
+};
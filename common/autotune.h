@@ -0,0 +1,375 @@
+/**
+ * x=auto: a short calibration on startup picks the thread count, the segment size and the
+ * primality strategy for this host and workload, instead of config.txt hard-coding them.
+ *
+ * The strategies are the segmented sieve with every base prime up to sqrt(y), the sieve with
+ * base primes only up to PREFILTER_LIMIT and Miller-Rabin on what survives, and linear division,
+ * which trial divides below 2^32 and runs Miller-Rabin above. Each one is timed on a sample at
+ * the top of the range, where the numbers are the most expensive, grown until it takes about
+ * CALIBRATION_SAMPLE_MILLIS. A strategy is scored by its setup, sieving the base primes, plus the
+ * whole range at the sampled rate, so a narrow window high up goes to the small prefilter and a
+ * dense range to the full sieve. Starting from one thread per CPU, the thread count is then
+ * halved for as long as that costs less than THREAD_SLOWDOWN_ALLOWED, and with straight division
+ * a few segment sizes around the L1 data cache are tried.
+ *
+ * The choice is stored in tune_profile (default primesearch.tune), one line per host and workload
+ * class: the bit lengths of y and of the range width, plus any setting the run pins. Later runs
+ * of the same class take it from there without calibrating, --retune calibrates them again.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "config.h"
+#include "divisibility_pool.h"
+#include "division_policies.h"
+#include "metrics.h"
+#include "sieve.h"
+#include "timing.h"
+#include "topology.h"
+
+// Time a calibration sample is grown to take
+const int CALIBRATION_SAMPLE_MILLIS = 40;
+// Ranges smaller than this are over sooner than they could be calibrated
+const uint64_t MIN_CALIBRATED_RANGE = 1 << 24;
+// Largest base prime table the full sieve is tried with, enough for every y up to 2^50
+const uint64_t MAX_CALIBRATED_SIEVE_LIMIT = 1 << 25;
+// Fewer threads are chosen as long as they are at most this much slower
+const double THREAD_SLOWDOWN_ALLOWED = 0.05;
+
+struct TuningChoice {
+    int threads = 1;
+    DivisionMode division = DivisionMode::Straight;
+    // 0 keeps the default
+    uint64_t segmentSize = 0;
+    uint64_t sieveLimit = 0;
+    // How the choice was made, printed along with it
+    std::string source;
+};
+
+// Print policy for the calibration samples: counts the primes and prints nothing
+class CalibrationCount {
+public:
+    static constexpr const char* NAME = "calibration";
+
+    explicit CalibrationCount(const Config& config) : counts(config.xNumThreads) {}
+
+    void reserve(int, size_t) {}
+
+    void primeFound(int threadId, uint64_t, TimePoint) { ++counts[threadId].primes; }
+
+    void chunkClaimed(int, uint64_t, uint64_t) {}
+
+    void rangeSearched(int, uint64_t, uint64_t) {}
+
+    bool finish(RunMetrics&) { return true; }
+
+private:
+    struct alignas(64) ThreadCount {
+        uint64_t primes = 0;
+    };
+
+    std::vector<ThreadCount> counts;
+};
+
+// Seconds the candidate settings take to search the last window numbers of the range. Straight
+// division samples with the given sieve, so its base primes are only sieved once per strategy.
+inline double timeSample(const Config& candidate, uint64_t window, const SegmentSieve* sieve) {
+    Config sample = candidate;
+    sample.startNumber = candidate.yNumber - (window - 1);
+    sample.dynamicScheduling = false;
+    sample.cachePath.clear();
+    sample.perfCounters = false;
+
+    CalibrationCount count(sample);
+    SearchReport report;
+    report.metrics.threads.resize(sample.xNumThreads);
+
+    auto start = std::chrono::steady_clock::now();
+    if (sieve == nullptr) {
+        LinearDivision::search(sample, count, report);
+    } else {
+        StraightDivision::search(sample, *sieve, count, report);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return std::max(elapsed.count(), 1e-6);
+}
+
+// Grow the sample window until a sample takes about CALIBRATION_SAMPLE_MILLIS or covers the
+// range, and return it along with the rate in numbers per second
+inline uint64_t sizeSample(const Config& candidate, const SegmentSieve* sieve, double& rate) {
+    uint64_t range = candidate.yNumber - candidate.startNumber + 1;
+    double target = CALIBRATION_SAMPLE_MILLIS / 1000.0;
+
+    uint64_t window = std::min<uint64_t>(range, 1 << 16);
+    while (true) {
+        double seconds = timeSample(candidate, window, sieve);
+        rate = window / seconds;
+        if (seconds >= target / 2 || window == range) return window;
+
+        // jump most of the way to the target at once
+        double grown = window * std::clamp(target / seconds, 2.0, 64.0);
+        window = (grown >= static_cast<double>(range)) ? range : static_cast<uint64_t>(grown);
+    }
+}
+
+inline std::string hostName() {
+    std::string name;
+#ifndef _WIN32
+    char buffer[256] = {};
+    if (gethostname(buffer, sizeof(buffer) - 1) == 0) name = buffer;
+#else
+    if (const char* computer = std::getenv("COMPUTERNAME")) name = computer;
+#endif
+    if (name.empty()) name = "localhost";
+    // the profile separates its fields with spaces
+    std::replace_if(name.begin(), name.end(), [](char c) { return c == ' ' || c == '\t' || c == '/'; }, '_');
+    return name;
+}
+
+// The host and workload class a choice is stored under
+inline std::string workloadKey(const Config& config, bool divisionPinned) {
+    CacheSizes caches = detectCacheSizes();
+    std::ostringstream key;
+    key << hostName() << "/cpus=" << countAvailableCpus() << "/l1=" << caches.l1Data << "/l2=" << caches.l2
+        << "/y_bits=" << std::bit_width(config.yNumber)
+        << "/width_bits=" << std::bit_width(config.yNumber - config.startNumber + 1) << "/division="
+        << (!divisionPinned ? "any" : config.divisionMode == DivisionMode::Linear ? "linear" : "straight")
+        << "/segment=" << config.segmentSize << "/sieve_limit=" << config.sieveLimit;
+    return key.str();
+}
+
+inline bool parseProfileNumber(const std::string& value, uint64_t& number) {
+    std::istringstream in(value);
+    return static_cast<bool>(in >> number) && in.eof();
+}
+
+// The choice stored for the workload, false if there is none
+inline bool loadTuningProfile(const std::string& path, const std::string& workload, TuningChoice& choice) {
+    std::ifstream in(path);
+    std::string prefix = "workload=" + workload + " ";
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.rfind(prefix, 0) != 0) continue;
+
+        TuningChoice stored;
+        std::istringstream fields(line.substr(prefix.size()));
+        std::string field;
+        while (fields >> field) {
+            size_t equals = field.find('=');
+            if (equals == std::string::npos) return false;
+            std::string key = field.substr(0, equals);
+            std::string value = field.substr(equals + 1);
+
+            uint64_t number = 0;
+            if (key == "division") {
+                stored.division = (value == "linear") ? DivisionMode::Linear : DivisionMode::Straight;
+            } else if (!parseProfileNumber(value, number)) {
+                return false;
+            } else if (key == "threads") {
+                stored.threads = static_cast<int>(std::clamp<uint64_t>(number, 1, 1 << 16));
+            } else if (key == "segment") {
+                stored.segmentSize = (number > 0) ? std::clamp<uint64_t>(number, 64, 1 << 26) : 0;
+            } else if (key == "sieve_limit") {
+                stored.sieveLimit = (number > 0) ? std::clamp<uint64_t>(number, 256, 1 << 26) : 0;
+            }
+        }
+        choice = stored;
+        return true;
+    }
+    return false;
+}
+
+// Replace the workload's line in the profile, keeping those of other hosts and workloads
+inline bool saveTuningProfile(const std::string& path, const std::string& workload, const TuningChoice& choice) {
+    std::string prefix = "workload=" + workload + " ";
+    std::vector<std::string> lines;
+    {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.rfind(prefix, 0) != 0) lines.push_back(line);
+        }
+    }
+    if (lines.empty()) lines.push_back("# Choices of x=auto, one line per host and workload");
+
+    std::ostringstream entry;
+    entry << prefix << "division=" << (choice.division == DivisionMode::Linear ? "linear" : "straight")
+          << " threads=" << choice.threads << " segment=" << choice.segmentSize
+          << " sieve_limit=" << choice.sieveLimit;
+    lines.push_back(entry.str());
+
+    // written next to the profile and renamed over it, so runs reading it never see half a file
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        for (const auto& line : lines) out << line << "\n";
+        out.flush();
+        if (!out) return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+// Time the candidate strategies, thread counts and segment sizes on samples of the range
+inline TuningChoice calibrate(const Config& config, bool divisionPinned) {
+    uint64_t range = config.yNumber - config.startNumber + 1;
+    int cpus = countAvailableCpus();
+    Config candidate = config;
+    candidate.xNumThreads = cpus;
+
+    // straight division with a sieve limit, or linear division with none
+    std::vector<std::pair<DivisionMode, uint64_t>> strategies;
+    if (!divisionPinned || config.divisionMode == DivisionMode::Straight) {
+        uint64_t root = integerSqrt(config.yNumber);
+        if (config.sieveLimit > 0) {
+            strategies.push_back({DivisionMode::Straight, config.sieveLimit});
+        } else {
+            if (root <= MAX_CALIBRATED_SIEVE_LIMIT) strategies.push_back({DivisionMode::Straight, MAX_CALIBRATED_SIEVE_LIMIT});
+            if (root > PREFILTER_LIMIT) strategies.push_back({DivisionMode::Straight, PREFILTER_LIMIT});
+        }
+    }
+    if (!divisionPinned || config.divisionMode == DivisionMode::Linear) {
+        strategies.push_back({DivisionMode::Linear, 0});
+    }
+
+    TuningChoice choice;
+    std::unique_ptr<SegmentSieve> chosenSieve;
+    uint64_t window = 0;
+    double rate = 0.0;
+    double bestEstimate = -1.0;
+    for (const auto& [division, sieveLimit] : strategies) {
+        candidate.divisionMode = division;
+        candidate.sieveLimit = sieveLimit;
+
+        std::unique_ptr<SegmentSieve> sieve;
+        double setupSeconds = 0.0;
+        if (division == DivisionMode::Straight) {
+            auto setupStart = std::chrono::steady_clock::now();
+            sieve = std::make_unique<SegmentSieve>(config.yNumber, sieveLimit);
+            setupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();
+        }
+
+        double sampleRate;
+        uint64_t sampleWindow = sizeSample(candidate, sieve.get(), sampleRate);
+        double estimate = setupSeconds + range / sampleRate;
+        if (bestEstimate < 0 || estimate < bestEstimate) {
+            bestEstimate = estimate;
+            choice.division = division;
+            choice.sieveLimit = sieveLimit;
+            chosenSieve = std::move(sieve);
+            window = sampleWindow;
+            rate = sampleRate;
+        }
+    }
+    candidate.divisionMode = choice.division;
+    candidate.sieveLimit = choice.sieveLimit;
+
+    // halve the threads while that is nearly as fast, leaving the other CPUs free
+    choice.threads = cpus;
+    for (int threads = cpus / 2; threads >= 1; threads /= 2) {
+        candidate.xNumThreads = threads;
+        double sampleRate = window / timeSample(candidate, window, chosenSieve.get());
+        if (sampleRate < rate * (1 - THREAD_SLOWDOWN_ALLOWED)) break;
+        rate = std::max(rate, sampleRate);
+        choice.threads = threads;
+    }
+    candidate.xNumThreads = choice.threads;
+
+    if (choice.division == DivisionMode::Straight && config.segmentSize == 0) {
+        uint64_t l1Data = detectCacheSizes().l1Data;
+        double bestRate = 0.0;
+        std::vector<uint64_t> tried;
+        for (uint64_t segment : {l1Data / 2, l1Data, 2 * l1Data, 4 * l1Data}) {
+            segment = std::clamp(segment, MIN_SEGMENT_SIZE, MAX_SEGMENT_SIZE);
+            if (std::find(tried.begin(), tried.end(), segment) != tried.end()) continue;
+            tried.push_back(segment);
+
+            candidate.segmentSize = segment;
+            double sampleRate = window / timeSample(candidate, window, chosenSieve.get());
+            if (sampleRate > bestRate) {
+                bestRate = sampleRate;
+                choice.segmentSize = segment;
+            }
+        }
+    }
+    return choice;
+}
+
+// Resolve x=auto with the choice stored for this host and workload, or a new calibration
+inline void autoTune(Config& config) {
+    // these only run with straight division
+    bool straightOnly = config.outputFormat == OutputFormat::Reduce || !config.checkpointPath.empty() ||
+                        !config.cachePath.empty();
+    if (straightOnly && !config.divisionFixed) config.divisionMode = DivisionMode::Straight;
+    bool divisionPinned = config.divisionFixed || straightOnly;
+
+    auto choice = std::make_shared<TuningChoice>();
+    uint64_t range = config.yNumber - config.startNumber + 1;
+    std::string workload = workloadKey(config, divisionPinned);
+
+    if (range < MIN_CALIBRATED_RANGE) {
+        // a thread per million numbers, the defaults for the rest
+        choice->threads = static_cast<int>(std::clamp<uint64_t>(range >> 20, 1, countAvailableCpus()));
+        choice->division = config.divisionMode;
+        choice->source = "range too small to calibrate";
+    } else if (!config.retune && loadTuningProfile(config.tuneProfilePath, workload, *choice)) {
+        choice->source = "from " + config.tuneProfilePath;
+    } else {
+        auto start = std::chrono::steady_clock::now();
+        *choice = calibrate(config, divisionPinned);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::ostringstream source;
+        source << "calibrated in " << elapsed.count() << "s";
+        choice->source = source.str();
+        if (!saveTuningProfile(config.tuneProfilePath, workload, *choice)) {
+            std::cerr << "Note: could not save the tuning profile to " << config.tuneProfilePath << std::endl;
+        }
+    }
+
+    config.xNumThreads = choice->threads;
+    config.divisionMode = choice->division;
+    if (choice->segmentSize > 0) config.segmentSize = choice->segmentSize;
+    if (choice->sieveLimit > 0) config.sieveLimit = choice->sieveLimit;
+    config.tuned = choice;
+}
+
+inline const char* strategyName(const Config& config) {
+    if (config.divisionMode == DivisionMode::Linear) {
+        if (config.yNumber < MILLER_RABIN_THRESHOLD) return "linear division, trial division";
+        if (config.startNumber >= MILLER_RABIN_THRESHOLD) return "linear division, Miller-Rabin";
+        return "linear division, trial division and Miller-Rabin";
+    }
+    if (SegmentSieve::baseLimitFor(config.yNumber, config.sieveLimit) == integerSqrt(config.yNumber)) {
+        return "straight division, segmented sieve";
+    }
+    return "straight division, sieve prefilter and Miller-Rabin";
+}
+
+// The settings x=auto chose, printed after the elapsed time
+inline void printTuning(const Config& config) {
+    std::cout << "Tuned x=" << config.xNumThreads << ", " << strategyName(config);
+    if (config.divisionMode == DivisionMode::Straight) {
+        uint64_t segmentSize = segmentSizeFor(config);
+        std::cout << ", segment " << segmentSize;
+        if (config.dynamicScheduling) std::cout << ", chunk " << chunkSizeFor(config, segmentSize);
+    }
+    std::cout << " (" << config.tuned->source << ")" << std::endl;
+}
@@ -0,0 +1,397 @@
+/**
+ * Compact binary output, used in place of the text print policies when config.txt sets format:
+ *   u32, u64  the primes in ascending order as a raw little-endian array
+ *   varint    the gaps between consecutive primes (the first from 0) as LEB128 varints
+ *   bitset    a wheel-30 bitset like the prime cache: byte k covers the 30 numbers from
+ *             30 * (start / 30 + k), one bit per residue 1, 7, 11, 13, 17, 19, 23, 29 (2, 3, 5 are implied)
+ *
+ * Nothing is held until the end of the run. The bitset file is sized and mapped up front, and
+ * each thread sets the bits of its primes in it as its segments are sieved. The arrays are
+ * encoded in pieces of up to BINARY_PIECE_PRIMES primes, and a piece is appended to the file as
+ * soon as everything below it has been written. Pieces finished ahead of their turn wait in
+ * memory up to BINARY_HELD_BYTES, then in an unlinked spill file beside the output, and are
+ * copied over once their turn comes. Straight division therefore searches in dynamic chunks
+ * for the arrays, which finish close to in order. With linear division the primes already
+ * arrive in order and are appended as they come.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "config.h"
+#include "metrics.h"
+#include "prime_cache.h"
+#include "timing.h"
+#include "varint.h"
+
+// Primes encoded into one piece before it is written out or set aside
+const size_t BINARY_PIECE_PRIMES = 1 << 16;
+// Encoded bytes of pieces waiting for their turn that are kept in memory, the rest are spilled
+const uint64_t BINARY_HELD_BYTES = 16 << 20;
+// Bytes copied from the spill file at a time
+const size_t BINARY_COPY_BLOCK = 1 << 20;
+
+// Write all of data at offset, retrying short writes
+inline bool writeAt(int fd, const uint8_t* data, size_t length, uint64_t offset) {
+#ifndef _WIN32
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written <= 0) return false;
+        data += written;
+        length -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+#else
+    (void)fd; (void)data; (void)length; (void)offset;
+    return false;
+#endif
+}
+
+// Read all of length bytes at offset, retrying short reads
+inline bool readAt(int fd, uint8_t* data, size_t length, uint64_t offset) {
+#ifndef _WIN32
+    while (length > 0) {
+        ssize_t received = pread(fd, data, length, static_cast<off_t>(offset));
+        if (received <= 0) return false;
+        data += received;
+        length -= static_cast<size_t>(received);
+        offset += static_cast<uint64_t>(received);
+    }
+    return true;
+#else
+    (void)fd; (void)data; (void)length; (void)offset;
+    return false;
+#endif
+}
+
+class BinaryOutput {
+public:
+    static constexpr const char* NAME = "binary";
+
+    explicit BinaryOutput(const Config& config)
+        : config(config), bitsetFormat(config.outputFormat == OutputFormat::Bitset),
+          width((config.outputFormat == OutputFormat::U32) ? 4 : (config.outputFormat == OutputFormat::U64) ? 8 : 0),
+          inOrder(config.divisionMode == DivisionMode::Linear), threadOutputs(config.xNumThreads),
+          nextStart(config.startNumber) {
+        if (!(bitsetFormat ? openBitset() : openArray())) failed.store(true);
+    }
+
+    void reserve(int, size_t) {}
+
+    void primeFound(int threadId, uint64_t prime, TimePoint) {
+        ThreadOutput& out = threadOutputs[threadId];
+        if (bitsetFormat) {
+            setBit(out, prime);
+        } else if (inOrder) {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            encode(stream, prime);
+            if (stream.count == BINARY_PIECE_PRIMES) {
+                writePiece(stream);
+                stream = Piece();
+            }
+        } else {
+            encode(out.piece, prime);
+            // where the piece's range starts is only known once the range is done
+            if (out.piece.count == BINARY_PIECE_PRIMES) {
+                out.rangePieces.push_back(setAside(std::move(out.piece)));
+                out.piece = Piece();
+            }
+        }
+    }
+
+    void chunkClaimed(int, uint64_t, uint64_t) {}
+
+    // Straight division has searched [start, end]: its pieces now know what they cover and go
+    // out once everything below them has
+    void rangeSearched(int threadId, uint64_t start, uint64_t end) {
+        ThreadOutput& out = threadOutputs[threadId];
+        if (bitsetFormat) {
+            finishBits(out);
+            return;
+        }
+
+        out.rangePieces.push_back(std::move(out.piece));
+        out.piece = Piece();
+        // each piece accounts for the numbers up to its last prime, the final one up to the range end
+        uint64_t coverStart = start;
+        for (size_t i = 0; i < out.rangePieces.size(); ++i) {
+            Piece& piece = out.rangePieces[i];
+            piece.coverStart = coverStart;
+            piece.coverEnd = (i + 1 == out.rangePieces.size()) ? end : piece.last;
+            coverStart = piece.coverEnd + 1;
+        }
+
+        std::lock_guard<std::mutex> lock(writeMutex);
+        for (Piece& piece : out.rangePieces) {
+            if (piece.coverStart == nextStart) {
+                writePiece(piece);
+            } else {
+                waiting.emplace(piece.coverStart, setAside(std::move(piece)));
+            }
+        }
+        out.rangePieces.clear();
+
+        for (auto it = waiting.find(nextStart); it != waiting.end(); it = waiting.find(nextStart)) {
+            writePiece(it->second);
+            waiting.erase(it);
+        }
+    }
+
+    bool finish(RunMetrics&) {
+        bool written = bitsetFormat ? closeBitset() : closeArray();
+        if (!written) std::cerr << "Error: Could not write " << config.outputPath << "!" << std::endl;
+        return written;
+    }
+
+private:
+    // Primes encoded one after the other. For varint the gap to the first prime depends on the
+    // piece before, so the first prime is kept aside and its gap written with the piece.
+    struct Piece {
+        uint64_t coverStart = 0;
+        uint64_t coverEnd = 0;
+        uint64_t count = 0;
+        uint64_t first = 0;
+        uint64_t last = 0;
+        std::vector<uint8_t> bytes;
+        // set aside in memory, counted against BINARY_HELD_BYTES
+        bool held = false;
+        // or in the spill file, bytes emptied
+        bool spilled = false;
+        uint64_t spillOffset = 0;
+        uint64_t spillLength = 0;
+    };
+
+    struct alignas(64) ThreadOutput {
+        // the primes of the current range not handed over yet
+        Piece piece;
+        // full pieces of the current range, set aside until the range is done
+        std::vector<Piece> rangePieces;
+        // the bitset byte being filled, and the first byte of the current range
+        bool rangeStarted = false;
+        uint64_t pendingByte = 0;
+        uint64_t rangeFirstByte = 0;
+        uint8_t pendingMask = 0;
+        uint8_t firstMask = 0;
+        // takes the writes while the primes stay within one byte
+        uint8_t unused = 0;
+    };
+
+    // Little-endian like every supported platform, so the arrays take the prime's own bytes
+    void encode(Piece& piece, uint64_t prime) const {
+        uint8_t encoded[16];
+        size_t length = static_cast<size_t>(width);
+        if (width > 0) {
+            std::memcpy(encoded, &prime, length);
+        } else {
+            length = (piece.count > 0) ? encodeVarint(prime - piece.last, encoded) : 0;
+        }
+
+        if (piece.count == 0) {
+            piece.bytes.reserve(BINARY_PIECE_PRIMES * ((width > 0) ? width : 2));
+            piece.first = prime;
+        }
+        piece.bytes.insert(piece.bytes.end(), encoded, encoded + length);
+        piece.last = prime;
+        ++piece.count;
+    }
+
+    // Keep a piece that has to wait for its turn, in memory while the budget lasts and in the
+    // spill file after that
+    Piece setAside(Piece&& piece) {
+        if (piece.held || piece.spilled) return std::move(piece);
+        uint64_t size = piece.bytes.size();
+        if (heldBytes.fetch_add(size, std::memory_order_relaxed) + size <= BINARY_HELD_BYTES) {
+            piece.held = true;
+            return std::move(piece);
+        }
+        heldBytes.fetch_sub(size, std::memory_order_relaxed);
+
+        piece.spillOffset = spillEnd.fetch_add(size, std::memory_order_relaxed);
+        piece.spillLength = size;
+        if (!writeAt(spillFd, piece.bytes.data(), size, piece.spillOffset)) failed.store(true);
+        piece.spilled = true;
+        std::vector<uint8_t>().swap(piece.bytes);
+        return std::move(piece);
+    }
+
+    // Append a piece to the output, under writeMutex
+    void writePiece(Piece& piece) {
+        if (piece.count > 0) {
+            if (width == 0) {
+                uint8_t gap[16];
+                append(gap, encodeVarint(piece.first - lastWritten, gap));
+            }
+            if (piece.spilled) {
+                copyFromSpill(piece);
+            } else {
+                append(piece.bytes.data(), piece.bytes.size());
+                if (piece.held) heldBytes.fetch_sub(piece.bytes.size(), std::memory_order_relaxed);
+            }
+            lastWritten = piece.last;
+        }
+        nextStart = piece.coverEnd + 1;
+    }
+
+    void copyFromSpill(const Piece& piece) {
+        copyBuffer.resize(BINARY_COPY_BLOCK);
+        for (uint64_t done = 0; done < piece.spillLength; ) {
+            size_t length = static_cast<size_t>(std::min<uint64_t>(piece.spillLength - done, BINARY_COPY_BLOCK));
+            if (!readAt(spillFd, copyBuffer.data(), length, piece.spillOffset + done)) {
+                failed.store(true);
+                return;
+            }
+            append(copyBuffer.data(), length);
+            done += length;
+        }
+    }
+
+    void append(const uint8_t* data, size_t length) {
+        if (failed.load(std::memory_order_relaxed)) return;
+        if (!writeAt(outputFd, data, length, outputEnd)) failed.store(true);
+        outputEnd += length;
+    }
+
+    bool openArray() {
+#ifdef _WIN32
+        return false;
+#else
+        outputFd = ::open(config.outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (outputFd < 0 || inOrder) return outputFd >= 0;
+
+        // the spill file is unlinked right away, so it goes when the run does however that ends
+        std::string spillPath = config.outputPath + ".spill";
+        spillFd = ::open(spillPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (spillFd < 0) return false;
+        ::unlink(spillPath.c_str());
+        return true;
+#endif
+    }
+
+    bool closeArray() {
+#ifdef _WIN32
+        return false;
+#else
+        if (outputFd >= 0) {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            if (stream.count > 0) writePiece(stream);
+            // only if a range was never reported, they are still in order
+            for (auto& [start, piece] : waiting) writePiece(piece);
+            waiting.clear();
+        }
+        bool closed = (outputFd < 0 || ::close(outputFd) == 0);
+        if (spillFd >= 0) ::close(spillFd);
+        return closed && outputFd >= 0 && !failed.load();
+#endif
+    }
+
+    bool openBitset() {
+#ifdef _WIN32
+        return false;
+#else
+        outputFd = ::open(config.outputPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (outputFd < 0) return false;
+
+        firstByte = config.startNumber / 30;
+        bitsetLength = config.yNumber / 30 - firstByte + 1;
+        if (ftruncate(outputFd, static_cast<off_t>(bitsetLength)) != 0) return false;
+        void* mapping = mmap(nullptr, bitsetLength, PROT_READ | PROT_WRITE, MAP_SHARED, outputFd, 0);
+        if (mapping == MAP_FAILED) return false;
+        bitset = static_cast<uint8_t*>(mapping);
+        return true;
+#endif
+    }
+
+    bool closeBitset() {
+#ifdef _WIN32
+        return false;
+#else
+        bool ok = bitset != nullptr && !failed.load();
+        if (bitset != nullptr) {
+            for (auto& out : threadOutputs) finishBits(out);
+            ok = (msync(bitset, bitsetLength, MS_SYNC) == 0) && ok;
+            munmap(bitset, bitsetLength);
+        }
+        if (outputFd >= 0) ok = (::close(outputFd) == 0) && ok;
+        return ok;
+#endif
+    }
+
+    // Bits are gathered a byte at a time and the byte is written once the primes move past it.
+    // Consecutive primes share a byte about half the time, so which byte takes the write is
+    // selected rather than branched on. The first and the last byte of a range may share numbers
+    // with the neighbouring ranges, so they are held back and set atomically by finishBits().
+    // Linear division hands out no ranges, and sets every bit atomically.
+    void setBit(ThreadOutput& out, uint64_t prime) {
+        int bit = WHEEL_BIT[prime % 30];
+        if (bit < 0 || bitset == nullptr) return;
+
+        uint64_t byte = prime / 30 - firstByte;
+        uint8_t mask = static_cast<uint8_t>(1u << bit);
+        if (inOrder) {
+            std::atomic_ref<uint8_t>(bitset[byte]).fetch_or(mask, std::memory_order_relaxed);
+            return;
+        }
+        if (!out.rangeStarted) {
+            out.rangeStarted = true;
+            out.rangeFirstByte = byte;
+            out.pendingByte = byte;
+        }
+
+        bool moved = byte != out.pendingByte;
+        uint8_t* target = !moved ? &out.unused
+                        : (out.pendingByte == out.rangeFirstByte) ? &out.firstMask : &bitset[out.pendingByte];
+        *target |= out.pendingMask;
+        out.pendingMask = static_cast<uint8_t>((moved ? 0 : out.pendingMask) | mask);
+        out.pendingByte = byte;
+    }
+
+    void finishBits(ThreadOutput& out) {
+        if (!out.rangeStarted) return;
+        std::atomic_ref<uint8_t>(bitset[out.rangeFirstByte]).fetch_or(out.firstMask, std::memory_order_relaxed);
+        std::atomic_ref<uint8_t>(bitset[out.pendingByte]).fetch_or(out.pendingMask, std::memory_order_relaxed);
+        out.rangeStarted = false;
+        out.pendingMask = 0;
+        out.firstMask = 0;
+    }
+
+    const Config& config;
+    bool bitsetFormat;
+    int width; // bytes per prime of u32 and u64, 0 for varint
+    bool inOrder;
+    std::vector<ThreadOutput> threadOutputs;
+    std::atomic<bool> failed{false};
+    int outputFd = -1;
+
+    // bitset
+    uint8_t* bitset = nullptr;
+    uint64_t firstByte = 0;
+    uint64_t bitsetLength = 0;
+
+    // arrays: what has been written so far, and the pieces waiting for their turn
+    std::mutex writeMutex;
+    uint64_t nextStart;
+    uint64_t lastWritten = 0;
+    uint64_t outputEnd = 0;
+    Piece stream;
+    std::map<uint64_t, Piece> waiting;
+    std::vector<uint8_t> copyBuffer;
+    std::atomic<uint64_t> heldBytes{0};
+    int spillFd = -1;
+    std::atomic<uint64_t> spillEnd{0};
+};
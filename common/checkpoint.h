@@ -0,0 +1,223 @@
+/**
+ * Checkpoints of a long search, so a run that is stopped can carry on with --resume.
+ *
+ * A checkpoint records the ranges searched so far. With format=reduce these are the finished
+ * ranges and their summaries. With ordered printing it is the range already written out, plus
+ * how many bytes of the output file that took. Ranges always consist of whole dynamic chunks,
+ * and the chunk size is stored along with them, so a resumed run skips exactly those chunks.
+ *
+ * The print policy saves a checkpoint from rangeSearched() once checkpoint_ms have passed since
+ * the last one. The snapshot is taken under the policy's own lock and written outside it. The
+ * file is written next to its final path, synced and renamed over it, so a crash leaves either
+ * the old checkpoint or the new one. With ordered printing the output is synced before the
+ * checkpoint that counts its bytes is written.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "config.h"
+#include "prime_summary.h"
+
+struct CheckpointRange {
+    uint64_t start;
+    uint64_t end;
+    PrimeSummary summary;
+};
+
+struct Checkpoint {
+    uint64_t startNumber = 0;
+    uint64_t yNumber = 0;
+    uint64_t chunkSize = 0;
+    std::string output;
+    // Size of the output file when it held exactly the searched ranges, -1 if it is not a file
+    long long outputOffset = -1;
+    // Ascending and disjoint
+    std::vector<CheckpointRange> ranges;
+    uint64_t sequence = 0;
+
+    // Whether [start, end] lies inside one of the searched ranges
+    bool covers(uint64_t start, uint64_t end) const {
+        auto after = std::upper_bound(ranges.begin(), ranges.end(), start,
+                                      [](uint64_t value, const CheckpointRange& range) { return value < range.start; });
+        if (after == ranges.begin()) return false;
+        const CheckpointRange& range = *std::prev(after);
+        return range.start <= start && end <= range.end;
+    }
+
+    bool save(const std::string& path) const {
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::trunc);
+            out << "primesearch checkpoint 1\n"
+                << "start=" << startNumber << "\n"
+                << "y=" << yNumber << "\n"
+                << "chunk=" << chunkSize << "\n"
+                << "output=" << output << "\n"
+                << "output_offset=" << outputOffset << "\n";
+            for (const auto& range : ranges) {
+                const PrimeSummary& s = range.summary;
+                out << "range=" << range.start << " " << range.end << " " << s.count << " "
+                    << static_cast<uint64_t>(s.sum >> 64) << " " << static_cast<uint64_t>(s.sum) << " " << s.first
+                    << " " << s.last << " " << s.largestGap << " " << s.gapStart << " " << s.twinPairs << "\n";
+            }
+            out << "end\n";
+            out.flush();
+            if (!out) return false;
+        }
+
+#ifndef _WIN32
+        int fd = ::open(temporary.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        bool synced = ::fsync(fd) == 0;
+        ::close(fd);
+        if (!synced) return false;
+#endif
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if (error) return false;
+
+#ifndef _WIN32
+        // the rename itself is only durable once the directory is synced
+        std::filesystem::path directory = std::filesystem::absolute(path).parent_path();
+        int directoryFd = ::open(directory.c_str(), O_RDONLY);
+        if (directoryFd >= 0) {
+            ::fsync(directoryFd);
+            ::close(directoryFd);
+        }
+#endif
+        return true;
+    }
+
+    // False if there is no checkpoint at path or it is incomplete
+    static bool load(const std::string& path, Checkpoint& checkpoint) {
+        std::ifstream in(path);
+        std::string line;
+        if (!std::getline(in, line) || line != "primesearch checkpoint 1") return false;
+
+        while (std::getline(in, line)) {
+            if (line == "end") return true;
+            size_t equals = line.find('=');
+            if (equals == std::string::npos) return false;
+            std::string key = line.substr(0, equals);
+            std::istringstream value(line.substr(equals + 1));
+
+            if (key == "start") value >> checkpoint.startNumber;
+            else if (key == "y") value >> checkpoint.yNumber;
+            else if (key == "chunk") value >> checkpoint.chunkSize;
+            else if (key == "output") value >> checkpoint.output;
+            else if (key == "output_offset") value >> checkpoint.outputOffset;
+            else if (key == "range") {
+                CheckpointRange range;
+                PrimeSummary& s = range.summary;
+                uint64_t sumHigh, sumLow;
+                value >> range.start >> range.end >> s.count >> sumHigh >> sumLow >> s.first >> s.last >>
+                    s.largestGap >> s.gapStart >> s.twinPairs;
+                s.sum = (static_cast<unsigned __int128>(sumHigh) << 64) | sumLow;
+                checkpoint.ranges.push_back(range);
+            }
+            if (!value) return false;
+        }
+        return false;
+    }
+};
+
+// Decides when the print policy takes the next checkpoint, and writes them out in order
+class CheckpointWriter {
+public:
+    CheckpointWriter(const Config& config, const char* output)
+        : path(config.checkpointPath), interval(std::chrono::milliseconds(config.checkpointMillis)),
+          lastClaim(std::chrono::steady_clock::now()) {
+        header.startNumber = config.startNumber;
+        header.yNumber = config.yNumber;
+        header.chunkSize = config.chunkSize;
+        header.output = output;
+    }
+
+    // True once per interval, the caller then fills in the snapshot. Called under the policy's lock.
+    bool due(Checkpoint& snapshot) {
+        if (path.empty()) return false;
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastClaim < interval) return false;
+        lastClaim = now;
+
+        snapshot = header;
+        snapshot.sequence = ++claimed;
+        return true;
+    }
+
+    // A snapshot older than one already saved is dropped
+    void save(const Checkpoint& snapshot) {
+        std::lock_guard<std::mutex> lock(saveMutex);
+        if (snapshot.sequence <= saved) return;
+        if (!snapshot.save(path)) {
+            std::cerr << "Error: Could not write the checkpoint " << path << "!" << std::endl;
+            return;
+        }
+        saved = snapshot.sequence;
+    }
+
+private:
+    std::string path;
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point lastClaim;
+    Checkpoint header;
+    uint64_t claimed = 0;
+    std::mutex saveMutex;
+    uint64_t saved = 0;
+};
+
+// Flush standard output and, if it is a file, sync it and return its size, -1 otherwise
+inline long long syncOutput() {
+    std::cout.flush();
+#ifndef _WIN32
+    std::fflush(stdout);
+    struct stat status;
+    if (::fstat(STDOUT_FILENO, &status) != 0 || !S_ISREG(status.st_mode)) return -1;
+    ::fsync(STDOUT_FILENO);
+    return static_cast<long long>(status.st_size);
+#else
+    return -1;
+#endif
+}
+
+// Cut standard output back to the bytes the checkpoint accounted for, dropping what a stopped run
+// wrote after it. False if the output holds fewer bytes, as when it was reopened with > instead
+// of >>, since the resumed run would then leave out everything the checkpoint covers.
+inline bool restoreOutput(long long offset) {
+    if (offset < 0) return true;
+    std::cout.flush();
+#ifndef _WIN32
+    std::fflush(stdout);
+    struct stat status;
+    if (::fstat(STDOUT_FILENO, &status) != 0 || !S_ISREG(status.st_mode)) return true;
+    if (status.st_size < offset) {
+        std::cerr << "Error: the output holds " << status.st_size << " bytes, the checkpoint recorded " << offset
+                  << ", append to it with >> when resuming!" << std::endl;
+        return false;
+    }
+    if (::ftruncate(STDOUT_FILENO, static_cast<off_t>(offset)) != 0) {
+        std::cerr << "Error: Could not cut the output back to the checkpoint!" << std::endl;
+        return false;
+    }
+    ::lseek(STDOUT_FILENO, static_cast<off_t>(offset), SEEK_SET);
+#endif
+    return true;
+}
@@ -0,0 +1,541 @@
+/**
+ * Scale-out over several processes: a coordinator hands leases of the range to worker
+ * processes over TCP, see lease_protocol.h, and merges their results in order.
+ *
+ * The coordinator splits [start, y] into leases of `lease` numbers. An idle worker gets the
+ * lowest lease that was given up by another worker, or else the next new one. New leases are
+ * handed out at most reorder_window ahead of the lowest uncommitted lease, so the finished
+ * leases waiting to be committed stay bounded; a worker asking while the window is full waits.
+ * A worker that disconnects, or reports no progress for lease_timeout_ms, is dropped and its
+ * lease goes to the next idle worker. Worker sockets are non-blocking and what arrives is kept
+ * per connection until a message is complete, so a worker that stops mid-message holds up no one
+ * else. Finished leases are committed in order: their summaries are appended into the run's
+ * PrimeSummary and, with text output, their primes printed.
+ *
+ * A worker connects to the coordinator and searches each lease with x threads. The threads
+ * claim slices of the lease and run StraightDivision::searchPrimeNumbers on each one, while a
+ * heartbeat thread reports how many numbers are done.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "config.h"
+#include "division_policies.h"
+#include "lease_protocol.h"
+#include "reduction_output.h"
+#include "sieve.h"
+#include "timing.h"
+#include "topology.h"
+#include "varint.h"
+
+// Print policy of a lease worker: every thread folds its slice into a summary and, if the
+// coordinator wants them, keeps its primes. Finished slices are collected in order.
+class LeaseOutput {
+public:
+    static constexpr const char* NAME = "lease";
+
+    LeaseOutput(int numThreads, bool keepPrimes) : threads(numThreads), keepPrimes(keepPrimes) {}
+
+    void reserve(int threadId, size_t count) {
+        if (keepPrimes) threads[threadId].primes.reserve(count);
+    }
+
+    void primeFound(int threadId, uint64_t prime, TimePoint) {
+        SliceResult& slice = threads[threadId];
+        slice.summary.add(prime);
+        if (keepPrimes) slice.primes.push_back(prime);
+    }
+
+    void chunkClaimed(int, uint64_t, uint64_t) {}
+
+    void rangeSearched(int threadId, uint64_t start, uint64_t) {
+        std::lock_guard<std::mutex> lock(slicesMutex);
+        slices.emplace(start, std::move(threads[threadId]));
+        threads[threadId] = SliceResult();
+    }
+
+    // The summary of every slice in order, and their primes as varint gaps from leaseStart on
+    PrimeSummary collect(uint64_t leaseStart, std::vector<uint8_t>& payload) {
+        PrimeSummary total;
+        uint64_t previous = leaseStart;
+        for (const auto& [start, slice] : slices) {
+            total.append(slice.summary);
+            for (uint64_t prime : slice.primes) {
+                appendVarint(payload, prime - previous);
+                previous = prime;
+            }
+        }
+        slices.clear();
+        return total;
+    }
+
+private:
+    struct alignas(64) SliceResult {
+        PrimeSummary summary;
+        std::vector<uint64_t> primes;
+    };
+
+    std::vector<SliceResult> threads;
+    bool keepPrimes;
+    std::mutex slicesMutex;
+    std::map<uint64_t, SliceResult> slices;
+};
+
+#ifndef _WIN32
+class LeaseWorker {
+public:
+    explicit LeaseWorker(const Config& config)
+        : config(config), segmentSize(segmentSizeFor(config)),
+          placements(placeThreads(config.affinity, config.xNumThreads)), metrics(config.xNumThreads) {}
+
+    // Search leases until the coordinator is done, returns false if it could not be reached or went away
+    bool run() {
+        fd = connectToEndpoint(config.coordinatorAddress);
+        if (fd < 0) {
+            std::cerr << "Error: Could not connect to the coordinator at " << config.coordinatorAddress << "!"
+                      << std::endl;
+            return false;
+        }
+
+        bool connected = send({LEASE_REQUEST, 0, 0, 0, 0});
+        while (connected) {
+            LeaseGrant grant;
+            if (!readFully(fd, &grant, sizeof(grant))) break;
+            if (grant.status == GRANT_DONE) {
+                ::close(fd);
+                return true;
+            }
+
+            // the base primes only depend on y, so they are sieved once per run
+            if (sieve == nullptr || sieveY != grant.y) {
+                sieve = std::make_unique<SegmentSieve>(grant.y, config.sieveLimit);
+                sieveY = grant.y;
+            }
+            connected = searchLease(grant);
+        }
+
+        std::cerr << "Error: Lost the connection to the coordinator!" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+private:
+    bool send(const LeaseMessage& message, const void* extra = nullptr, size_t extraLength = 0,
+              const std::vector<uint8_t>* payload = nullptr) {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        return writeFully(fd, &message, sizeof(message)) && writeFully(fd, extra, extraLength) &&
+               (payload == nullptr || writeFully(fd, payload->data(), payload->size()));
+    }
+
+    bool searchLease(const LeaseGrant& grant) {
+        Config leaseConfig = config;
+        leaseConfig.startNumber = grant.start;
+        leaseConfig.yNumber = grant.end;
+        uint64_t sliceSize = chunkSizeFor(leaseConfig, segmentSize);
+        uint64_t numSlices = (grant.end - grant.start) / sliceSize + 1;
+
+        LeaseOutput output(config.xNumThreads, grant.wantPrimes != 0);
+        std::atomic<uint64_t> nextSlice{0};
+        std::atomic<uint64_t> progress{0};
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < config.xNumThreads; ++i) {
+            threads.emplace_back([&, i] {
+                pinWorker(placements[i], metrics[i]);
+                while (true) {
+                    uint64_t slice = nextSlice.fetch_add(1, std::memory_order_relaxed);
+                    if (slice >= numSlices) break;
+                    uint64_t start = grant.start + slice * sliceSize;
+                    uint64_t end = (grant.end - start < sliceSize) ? grant.end : start + sliceSize - 1;
+                    StraightDivision::searchPrimeNumbers(*sieve, nullptr, output, start, end, segmentSize, i,
+                                                         metrics[i]);
+                    progress.fetch_add(end - start + 1, std::memory_order_relaxed);
+                }
+            });
+        }
+
+        // the coordinator takes a lease back when its progress stalls, so report it while searching
+        bool searching = true;
+        bool heartbeatsSent = true;
+        std::mutex heartbeatMutex;
+        std::condition_variable searchDone;
+        std::thread heartbeat([&] {
+            auto interval = std::chrono::milliseconds(std::max<uint32_t>(grant.heartbeatMillis, 1));
+            std::unique_lock<std::mutex> lock(heartbeatMutex);
+            while (!searchDone.wait_for(lock, interval, [&] { return !searching; })) {
+                if (!send({LEASE_HEARTBEAT, 0, grant.leaseId, progress.load(std::memory_order_relaxed), 0})) {
+                    heartbeatsSent = false;
+                    return;
+                }
+            }
+        });
+
+        for (auto& t : threads) t.join();
+        {
+            std::lock_guard<std::mutex> lock(heartbeatMutex);
+            searching = false;
+        }
+        searchDone.notify_all();
+        heartbeat.join();
+        if (!heartbeatsSent) return false;
+
+        std::vector<uint8_t> payload;
+        LeaseSummary summary = LeaseSummary::from(output.collect(grant.start, payload));
+        return send({LEASE_RESULT, 0, grant.leaseId, grant.end - grant.start + 1, payload.size()}, &summary,
+                    sizeof(summary), &payload);
+    }
+
+    const Config& config;
+    uint64_t segmentSize;
+    std::vector<Placement> placements;
+    std::vector<ThreadMetrics> metrics;
+    std::unique_ptr<SegmentSieve> sieve;
+    uint64_t sieveY = 0;
+    int fd = -1;
+    std::mutex sendMutex;
+};
+
+class Coordinator {
+public:
+    explicit Coordinator(const Config& config)
+        : config(config), rangeStart(config.startNumber), rangeEnd(config.yNumber),
+          leaseSize(config.leaseSize), numLeases((config.yNumber - config.startNumber) / config.leaseSize + 1),
+          wantPrimes(config.outputFormat == OutputFormat::Text) {}
+
+    // Hand out leases to the workers connecting on listenFd until every lease is committed
+    void run(int listenFd) {
+        auto timeout = std::chrono::milliseconds(config.leaseTimeoutMillis);
+        int pollMillis = std::max(config.leaseTimeoutMillis / 4, 1);
+
+        while (nextToCommit < numLeases) {
+            std::vector<pollfd> watched = {{listenFd, POLLIN, 0}};
+            for (const auto& worker : workers) watched.push_back({worker->fd, POLLIN, 0});
+            if (::poll(watched.data(), watched.size(), pollMillis) < 0) continue;
+
+            // workers dropped below are closed only after this round of events
+            std::vector<std::shared_ptr<WorkerConnection>> polled = workers;
+            for (size_t i = 1; i < watched.size(); ++i) {
+                if (watched[i].revents == 0) continue;
+                auto& worker = polled[i - 1];
+                if (worker->fd >= 0 && !receive(*worker)) dropWorker(*worker, "disconnected");
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            for (auto& worker : workers) {
+                if (worker->fd >= 0 && worker->hasLease && now - worker->lastProgress > timeout) {
+                    dropWorker(*worker, "stalled");
+                }
+            }
+            workers.erase(std::remove_if(workers.begin(), workers.end(), [](const auto& worker) {
+                return worker->fd < 0;
+            }), workers.end());
+
+            if (watched[0].revents != 0) acceptWorker(listenFd);
+            for (auto& worker : workers) {
+                if (worker->waiting) grant(*worker);
+            }
+        }
+
+        // every worker is waiting for its next lease by now
+        for (auto& worker : workers) {
+            if (worker->fd < 0) continue;
+            LeaseGrant done = {GRANT_DONE, 0, 0, 0, 0, 0, 0, 0};
+            writeFully(worker->fd, &done, sizeof(done));
+            ::close(worker->fd);
+        }
+
+        std::cout << "Leases: " << numLeases << " of " << leaseSize << " numbers, searched by " << workersSeen
+                  << " worker(s), " << reassigned << " reassigned" << std::endl;
+        printSummary(total);
+    }
+
+private:
+    struct Lease {
+        uint64_t id;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    struct WorkerConnection {
+        int fd;
+        int id;
+        bool waiting = false;
+        bool hasLease = false;
+        Lease lease{};
+        uint64_t progress = 0;
+        std::chrono::steady_clock::time_point lastProgress;
+        // Bytes received that do not make up a whole message yet
+        std::vector<uint8_t> inbox;
+    };
+
+    struct FinishedLease {
+        int workerId;
+        uint64_t start;
+        PrimeSummary summary;
+        std::vector<uint8_t> payload;
+    };
+
+    Lease leaseAt(uint64_t id) const {
+        uint64_t start = rangeStart + id * leaseSize;
+        uint64_t end = (rangeEnd - start < leaseSize) ? rangeEnd : start + leaseSize - 1;
+        return {id, start, end};
+    }
+
+    void acceptWorker(int listenFd) {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0) return;
+        // reads never wait for a worker, a partial message stays in its inbox until the rest arrives
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        auto worker = std::make_shared<WorkerConnection>();
+        worker->fd = fd;
+        worker->id = workersSeen++;
+        workers.push_back(worker);
+    }
+
+    // Take in what the worker has sent and handle every complete message, false once it is gone
+    bool receive(WorkerConnection& worker) {
+        uint8_t buffer[64 * 1024];
+        bool open = true;
+        while (open) {
+            ssize_t received = ::read(worker.fd, buffer, sizeof(buffer));
+            if (received > 0) {
+                worker.inbox.insert(worker.inbox.end(), buffer, buffer + received);
+            } else if (received < 0 && errno == EINTR) {
+                continue;
+            } else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                open = false;
+            }
+        }
+
+        size_t used = 0;
+        while (true) {
+            size_t length = 0;
+            if (!handleMessage(worker, worker.inbox.data() + used, worker.inbox.size() - used, length)) {
+                return false;
+            }
+            if (length == 0) break;
+            used += length;
+        }
+        worker.inbox.erase(worker.inbox.begin(), worker.inbox.begin() + used);
+        return open;
+    }
+
+    // Handle the message at the front of data, setting length to its size, or to 0 if it is
+    // not complete yet. False if the worker broke the protocol.
+    bool handleMessage(WorkerConnection& worker, const uint8_t* data, size_t available, size_t& length) {
+        LeaseMessage message;
+        if (available < sizeof(message)) return true;
+        std::memcpy(&message, data, sizeof(message));
+
+        if (message.type == LEASE_REQUEST) {
+            length = sizeof(message);
+            worker.waiting = true;
+            return !worker.hasLease;
+        }
+
+        if (!worker.hasLease || message.leaseId != worker.lease.id) return false;
+
+        if (message.type == LEASE_HEARTBEAT) {
+            length = sizeof(message);
+            if (message.progress > worker.progress) {
+                worker.progress = message.progress;
+                worker.lastProgress = std::chrono::steady_clock::now();
+            }
+            return true;
+        }
+
+        if (message.type != LEASE_RESULT) return false;
+
+        LeaseSummary summary;
+        if (available < sizeof(message) + sizeof(summary)) return true;
+        std::memcpy(&summary, data + sizeof(message), sizeof(summary));
+        // no more than a 10-byte varint per prime
+        if (message.payload > summary.count * 10) return false;
+        size_t payloadStart = sizeof(message) + sizeof(summary);
+        if (available - payloadStart < message.payload) return true;
+
+        length = payloadStart + message.payload;
+        FinishedLease finished = {worker.id, worker.lease.start, summary.toSummary(),
+                                  std::vector<uint8_t>(data + payloadStart, data + length)};
+
+        if (worker.lease.id >= nextToCommit) finishedLeases.emplace(worker.lease.id, std::move(finished));
+        worker.hasLease = false;
+        worker.waiting = true;
+        commitFinished();
+        return true;
+    }
+
+    // Give the worker the lowest lease given up by another, or the next new one within the window
+    void grant(WorkerConnection& worker) {
+        Lease lease;
+        if (!returnedLeases.empty()) {
+            auto lowest = std::min_element(returnedLeases.begin(), returnedLeases.end(),
+                                           [](const Lease& a, const Lease& b) { return a.id < b.id; });
+            lease = *lowest;
+            returnedLeases.erase(lowest);
+        } else if (nextLease < numLeases && nextLease - nextToCommit < config.reorderWindow) {
+            lease = leaseAt(nextLease++);
+        } else {
+            return;
+        }
+
+        LeaseGrant message = {GRANT_LEASE, wantPrimes ? 1u : 0u,
+                              static_cast<uint32_t>(std::max(config.leaseTimeoutMillis / 4, 1)), 0,
+                              lease.id, lease.start, lease.end, rangeEnd};
+        worker.waiting = false;
+        worker.hasLease = true;
+        worker.lease = lease;
+        worker.progress = 0;
+        worker.lastProgress = std::chrono::steady_clock::now();
+        if (!writeFully(worker.fd, &message, sizeof(message))) dropWorker(worker, "disconnected");
+    }
+
+    void dropWorker(WorkerConnection& worker, const char* reason) {
+        if (worker.hasLease) {
+            std::cout << "Note: worker " << worker.id << " " << reason << ", lease [" << worker.lease.start << ", "
+                      << worker.lease.end << "] reassigned" << std::endl;
+            returnedLeases.push_back(worker.lease);
+            ++reassigned;
+        }
+        ::close(worker.fd);
+        worker.fd = -1;
+        worker.hasLease = false;
+        worker.waiting = false;
+    }
+
+    // Fold in, and with text output print, every finished lease that follows on from the committed ones
+    void commitFinished() {
+        std::string text;
+        char line[64];
+        for (auto it = finishedLeases.find(nextToCommit); it != finishedLeases.end();
+             it = finishedLeases.find(nextToCommit)) {
+            const FinishedLease& lease = it->second;
+            total.append(lease.summary);
+
+            const uint8_t* gaps = lease.payload.data();
+            const uint8_t* gapsEnd = gaps + lease.payload.size();
+            uint64_t prime = lease.start;
+            while (gaps < gapsEnd) {
+                prime += decodeVarint(gaps);
+                int length = std::snprintf(line, sizeof(line), "Worker ID: %d | Prime: %llu\n", lease.workerId,
+                                           static_cast<unsigned long long>(prime));
+                text.append(line, length);
+            }
+            std::cout.write(text.data(), text.size());
+            text.clear();
+
+            finishedLeases.erase(it);
+            ++nextToCommit;
+        }
+    }
+
+    const Config& config;
+    uint64_t rangeStart;
+    uint64_t rangeEnd;
+    uint64_t leaseSize;
+    uint64_t numLeases;
+    bool wantPrimes;
+
+    std::vector<std::shared_ptr<WorkerConnection>> workers;
+    int workersSeen = 0;
+    uint64_t reassigned = 0;
+
+    uint64_t nextLease = 0;
+    uint64_t nextToCommit = 0;
+    std::vector<Lease> returnedLeases;
+    std::map<uint64_t, FinishedLease> finishedLeases;
+    PrimeSummary total;
+};
+#endif
+
+// Worker mode: search the leases handed out by the coordinator at config.coordinatorAddress
+inline int runLeaseWorker(const Config& config) {
+#ifdef _WIN32
+    (void)config;
+    std::cerr << "Error: worker processes need POSIX sockets!" << std::endl;
+    return 1;
+#else
+    LeaseWorker worker(config);
+    return worker.run() ? 0 : 1;
+#endif
+}
+
+// Coordinator mode: listen on config.coordinatorAddress, start config.spawnWorkers local workers
+// and hand out [start, y] until it is all committed
+inline int runCoordinator(const Config& config) {
+#ifdef _WIN32
+    (void)config;
+    std::cerr << "Error: the coordinator needs POSIX sockets!" << std::endl;
+    return 1;
+#else
+    if (config.outputFormat != OutputFormat::Text && config.outputFormat != OutputFormat::Reduce) {
+        std::cerr << "Error: the coordinator prints text or format=reduce!" << std::endl;
+        return 1;
+    }
+
+    auto start = Clock::now();
+    int listenFd = listenOnEndpoint(config.coordinatorAddress);
+    if (listenFd < 0) {
+        std::cerr << "Error: Could not listen on " << config.coordinatorAddress << "!" << std::endl;
+        return 1;
+    }
+
+    // with port 0 the system picks one, which local workers need to know
+    Config workerConfig = config;
+    sockaddr_storage bound;
+    socklen_t boundLength = sizeof(bound);
+    if (::getsockname(listenFd, reinterpret_cast<sockaddr*>(&bound), &boundLength) == 0) {
+        int port = ntohs(bound.ss_family == AF_INET6 ? reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port
+                                                     : reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+        std::string host = config.coordinatorAddress.substr(0, config.coordinatorAddress.rfind(':'));
+        workerConfig.coordinatorAddress = (host.empty() ? "127.0.0.1" : host) + ":" + std::to_string(port);
+    }
+    std::cout << "Coordinator listening on " << workerConfig.coordinatorAddress << std::endl;
+
+    std::vector<pid_t> children;
+    for (int i = 0; i < config.spawnWorkers; ++i) {
+        std::cout.flush();
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            ::close(listenFd);
+            int status = runLeaseWorker(workerConfig);
+            std::cout.flush();
+            ::_exit(status);
+        }
+        if (pid > 0) children.push_back(pid);
+    }
+
+    Coordinator coordinator(config);
+    coordinator.run(listenFd);
+    ::close(listenFd);
+    for (pid_t child : children) ::waitpid(child, nullptr, 0);
+
+    printStartAndEnd(start, Clock::now());
+    return 0;
+#endif
+}
@@ -0,0 +1,418 @@
+/**
+ * Run configuration: config.txt keys, command-line flags and the named variation presets.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+enum class PrintMode { Immediate, Deferred, Ordered };
+enum class DivisionMode { Straight, Linear };
+enum class AffinityMode { None, Compact, Scatter };
+enum class OutputFormat { Text, U32, U64, Varint, Bitset, Reduce };
+enum class ClusterRole { None, Coordinator, Worker };
+
+// Default upper bound in milliseconds on how long a found prime waits before it is written
+const int DEFAULT_FLUSH_MS = 10;
+
+// Default number of finished chunks ordered printing holds ahead of the lowest unfinished one
+const uint64_t DEFAULT_REORDER_WINDOW = 64;
+
+// Default number of sieved segments the query server keeps, 4 KB each
+const uint64_t DEFAULT_SEGMENT_CACHE = 1024;
+
+// Default milliseconds between two checkpoints of a run
+const int DEFAULT_CHECKPOINT_MS = 10 * 1000;
+
+// Default number of events, and of primes, each thread's trace keeps
+const size_t DEFAULT_TRACE_EVENTS = 1 << 15;
+
+struct Checkpoint;
+struct TuningChoice;
+class RunTrace;
+
+// Defaults for the coordinator: numbers per lease, and how long a lease may go without progress
+const uint64_t DEFAULT_LEASE_SIZE = 1 << 24;
+const int DEFAULT_LEASE_TIMEOUT_MS = 10 * 1000;
+
+struct Config {
+    int xNumThreads = 0;
+    // x=auto: calibrate the threads, division and sieve for this host, or reuse the choice stored
+    // in tuneProfilePath (see autotune.h). retune calibrates again even if one is stored.
+    bool autoTune = false;
+    bool retune = false;
+    std::string tuneProfilePath = "primesearch.tune";
+    std::shared_ptr<const TuningChoice> tuned;
+    uint64_t yNumber = 0;
+    uint64_t startNumber = 1;
+    bool dynamicScheduling = false;
+    // Numbers per dynamic chunk and per sieve segment, 0 to size them from the detected caches
+    uint64_t chunkSize = 0;
+    uint64_t segmentSize = 0;
+    AffinityMode affinity = AffinityMode::None;
+    // Set by --affinity, so the config file cannot replace the policy asked for
+    bool affinityFixed = false;
+    int flushMillis = DEFAULT_FLUSH_MS;
+    PrintMode printMode = PrintMode::Immediate;
+    size_t reorderWindow = DEFAULT_REORDER_WINDOW;
+    DivisionMode divisionMode = DivisionMode::Straight;
+    // Set by --division and --preset, so x=auto keeps the scheme asked for
+    bool divisionFixed = false;
+    // Largest base prime the sieve crosses off with, 0 for the default of sieve.h
+    uint64_t sieveLimit = 0;
+    std::string configPath = "config.txt";
+    // Per-thread metrics report, written only when a path is given
+    std::string metricsPath;
+    bool perfCounters = false;
+    // Timeline written as Chrome trace-event JSON, only when a path is given (see trace.h)
+    std::string tracePath;
+    size_t traceEvents = DEFAULT_TRACE_EVENTS;
+    std::shared_ptr<RunTrace> trace;
+    // Wheel-30 prime cache file reused and extended by straight division, none if empty
+    std::string cachePath;
+    // Binary formats go to outputPath instead of printing a line per prime, reduce only prints aggregates
+    OutputFormat outputFormat = OutputFormat::Text;
+    std::string outputPath = "primes.bin";
+    // Query server
+    std::string socketPath = "primesearch.sock";
+    uint64_t segmentCacheSize = DEFAULT_SEGMENT_CACHE;
+    // Count-only mode reports pi(y) - pi(start - 1) without enumerating, optionally checked
+    // against the enumerating search
+    bool countOnly = false;
+    bool verifyCount = false;
+    // Multi-process runs: the coordinator listens on coordinatorAddress and workers connect to it
+    ClusterRole clusterRole = ClusterRole::None;
+    std::string coordinatorAddress = "127.0.0.1:7700";
+    uint64_t leaseSize = DEFAULT_LEASE_SIZE;
+    int leaseTimeoutMillis = DEFAULT_LEASE_TIMEOUT_MS;
+    // Worker processes the coordinator starts on this host
+    int spawnWorkers = 0;
+    // Checkpoints saved every checkpointMillis, and with resume the one the run carries on from
+    std::string checkpointPath;
+    int checkpointMillis = DEFAULT_CHECKPOINT_MS;
+    bool resume = false;
+    std::shared_ptr<const Checkpoint> resumeFrom;
+};
+
+// The four original programs, kept as named combinations of print mode and division scheme
+struct Preset {
+    const char* name;
+    PrintMode printMode;
+    DivisionMode divisionMode;
+};
+
+const Preset PRESETS[] = {
+    {"variation1", PrintMode::Immediate, DivisionMode::Straight},
+    {"variation2", PrintMode::Immediate, DivisionMode::Linear},
+    {"variation3", PrintMode::Deferred, DivisionMode::Straight},
+    {"variation4", PrintMode::Deferred, DivisionMode::Linear},
+};
+
+inline std::string trim(std::string value) {
+    // Trim leading/trailing spaces
+    value.erase(0, value.find_first_not_of(" \t\r"));
+    value.erase(value.find_last_not_of(" \t\r") + 1);
+    return value;
+}
+
+inline bool isNumValid(std::string value) {
+    value = trim(value);
+
+    // Check if value is a valid number that fits in 64 bits
+    if (value.empty() || !std::all_of(value.begin(), value.end(), ::isdigit)) {
+        std::cerr << "Error: Invalid input!" << std::endl;
+        return false;
+    }
+
+    try {
+        std::stoull(value);
+    } catch (const std::out_of_range&) {
+        std::cerr << "Error: Invalid input!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+inline bool parseScheduler(std::string value, bool& dynamicScheduling) {
+    value = trim(value);
+
+    if (value != "static" && value != "dynamic") {
+        std::cerr << "Error: Invalid input!" << std::endl;
+        return false;
+    }
+
+    dynamicScheduling = (value == "dynamic");
+    return true;
+}
+
+inline bool parseAffinity(std::string value, AffinityMode& affinity) {
+    value = trim(value);
+
+    const std::pair<const char*, AffinityMode> modes[] = {
+        {"none", AffinityMode::None}, {"compact", AffinityMode::Compact}, {"scatter", AffinityMode::Scatter},
+    };
+    for (const auto& [name, candidate] : modes) {
+        if (value == name) {
+            affinity = candidate;
+            return true;
+        }
+    }
+
+    std::cerr << "Error: Invalid input!" << std::endl;
+    return false;
+}
+
+inline bool parseOutputFormat(std::string value, OutputFormat& format) {
+    value = trim(value);
+
+    const std::pair<const char*, OutputFormat> formats[] = {
+        {"text", OutputFormat::Text}, {"u32", OutputFormat::U32}, {"u64", OutputFormat::U64},
+        {"varint", OutputFormat::Varint}, {"bitset", OutputFormat::Bitset}, {"reduce", OutputFormat::Reduce},
+    };
+    for (const auto& [name, candidate] : formats) {
+        if (value == name) {
+            format = candidate;
+            return true;
+        }
+    }
+
+    std::cerr << "Error: Invalid input!" << std::endl;
+    return false;
+}
+
+inline bool applyPreset(const std::string& name, Config& config) {
+    for (const Preset& preset : PRESETS) {
+        if (name == preset.name) {
+            config.printMode = preset.printMode;
+            config.divisionMode = preset.divisionMode;
+            return true;
+        }
+    }
+
+    std::cerr << "Error: Unknown preset " << name << "!" << std::endl;
+    return false;
+}
+
+inline void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --preset=NAME           variation1, variation2, variation3 or variation4\n"
+              << "  --print=MODE            immediate (A1), deferred (A2) or ordered (A3)\n"
+              << "  --division=SCHEME       straight (B1) or linear (B2)\n"
+              << "  --config=PATH           config file to read (default config.txt)\n"
+              << "  --metrics=PATH          write per-thread metrics as JSON, or CSV if PATH ends in .csv\n"
+              << "  --perf                  add hardware counters to the metrics (Linux perf_event_open)\n"
+              << "  --trace=PATH            write a timeline of every thread as Chrome trace-event JSON\n"
+              << "  --affinity=POLICY       pin workers to cores: none, compact or scatter (Linux)\n"
+              << "  --cache=PATH            reuse and extend a prime cache file (straight division)\n"
+              << "  --count                 only count the primes in [start, y], without listing them\n"
+              << "  --count=verify          count, then check the count against the enumerating search\n"
+              << "  --socket=PATH           Unix socket the query server listens on\n"
+              << "  --checkpoint=PATH       save the progress to PATH every checkpoint_ms\n"
+              << "  --resume                carry on from the checkpoint of a stopped run\n"
+              << "  --retune                with x=auto, calibrate again instead of using the stored profile\n"
+              << "  --coordinator[=ADDR]    hand out leases of the range to worker processes on HOST:PORT\n"
+              << "  --worker[=ADDR]         search leases from the coordinator on HOST:PORT\n"
+              << "  --help                  show this message" << std::endl;
+}
+
+// Flags are applied in order, so --print or --division after --preset override it
+inline bool parseCommandLine(int argc, char* argv[], Config& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        std::string value = argument.substr(argument.find('=') + 1);
+
+        if (argument == "--help") {
+            printUsage(argv[0]);
+            return false;
+        } else if (argument.rfind("--preset=", 0) == 0) {
+            if (!applyPreset(value, config)) return false;
+            config.divisionFixed = true;
+        } else if (argument == "--print=immediate") {
+            config.printMode = PrintMode::Immediate;
+        } else if (argument == "--print=deferred") {
+            config.printMode = PrintMode::Deferred;
+        } else if (argument == "--print=ordered") {
+            config.printMode = PrintMode::Ordered;
+        } else if (argument == "--division=straight" || argument == "--division=linear") {
+            config.divisionMode = (value == "linear") ? DivisionMode::Linear : DivisionMode::Straight;
+            config.divisionFixed = true;
+        } else if (argument.rfind("--config=", 0) == 0) {
+            config.configPath = value;
+        } else if (argument.rfind("--metrics=", 0) == 0) {
+            config.metricsPath = value;
+        } else if (argument == "--perf") {
+            config.perfCounters = true;
+        } else if (argument.rfind("--trace=", 0) == 0) {
+            config.tracePath = value;
+        } else if (argument.rfind("--affinity=", 0) == 0) {
+            if (!parseAffinity(value, config.affinity)) return false;
+            config.affinityFixed = true;
+        } else if (argument.rfind("--cache=", 0) == 0) {
+            config.cachePath = value;
+        } else if (argument == "--count" || argument == "--count=verify") {
+            config.countOnly = true;
+            config.verifyCount = (argument == "--count=verify");
+        } else if (argument.rfind("--socket=", 0) == 0) {
+            config.socketPath = value;
+        } else if (argument.rfind("--checkpoint=", 0) == 0) {
+            config.checkpointPath = value;
+        } else if (argument == "--resume") {
+            config.resume = true;
+        } else if (argument == "--retune") {
+            config.retune = true;
+        } else if (argument == "--coordinator" || argument.rfind("--coordinator=", 0) == 0) {
+            config.clusterRole = ClusterRole::Coordinator;
+            if (argument != "--coordinator") config.coordinatorAddress = value;
+        } else if (argument == "--worker" || argument.rfind("--worker=", 0) == 0) {
+            config.clusterRole = ClusterRole::Worker;
+            if (argument != "--worker") config.coordinatorAddress = value;
+        } else {
+            std::cerr << "Error: Unknown option " << argument << "!" << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read key=value lines from config.configPath, printing an error and returning false on bad input
+inline bool loadConfigFile(Config& config) {
+    // Open file for reading
+    std::ifstream configFile(config.configPath);
+
+    // Check if file was opened successfully
+    if (!configFile) {
+        std::cout << "Error: Could not open the file!" << std::endl;
+        return false;
+    }
+
+    std::string line;
+
+    // validate the input from config file
+    while (std::getline(configFile, line)) {
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) continue;
+
+        std::string key = trim(line.substr(0, equals));
+        std::string value = line.substr(equals + 1);
+
+        if (key == "scheduler") {
+            if (!parseScheduler(value, config.dynamicScheduling)) return false;
+            continue;
+        }
+
+        // the command line takes precedence over the config file for the policy
+        if (key == "affinity") {
+            if (!config.affinityFixed && !parseAffinity(value, config.affinity)) return false;
+            continue;
+        }
+
+        if (key == "format") {
+            if (!parseOutputFormat(value, config.outputFormat)) return false;
+            continue;
+        }
+
+        if (key == "checkpoint") {
+            if (config.checkpointPath.empty()) config.checkpointPath = trim(value);
+            continue;
+        }
+
+        if (key == "output") {
+            config.outputPath = trim(value);
+            continue;
+        }
+
+        // the command line takes precedence over the config file for the socket
+        if (key == "socket") {
+            if (config.socketPath == Config().socketPath) config.socketPath = trim(value);
+            continue;
+        }
+
+        if (key == "tune_profile") {
+            config.tuneProfilePath = trim(value);
+            continue;
+        }
+
+        // one thread per hardware thread until the calibration has picked the count
+        if (key == "x" && trim(value) == "auto") {
+            config.autoTune = true;
+            config.xNumThreads = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+            continue;
+        }
+
+        // the command line takes precedence over the config file for the address
+        if (key == "coordinator") {
+            if (config.coordinatorAddress == Config().coordinatorAddress) config.coordinatorAddress = trim(value);
+            continue;
+        }
+
+        if (key != "x" && key != "y" && key != "start" && key != "chunk" && key != "segment" &&
+            key != "flush_ms" && key != "segment_cache" && key != "reorder_window" && key != "lease" &&
+            key != "lease_timeout_ms" && key != "spawn" && key != "checkpoint_ms" && key != "sieve_limit" &&
+            key != "trace_events") {
+            continue;
+        }
+        if (!isNumValid(value)) return false;
+        uint64_t number = std::stoull(trim(value));
+
+        if (key == "x") {
+            config.autoTune = false;
+            config.xNumThreads = static_cast<int>(std::min<uint64_t>(number, 1 << 16));
+        } else if (key == "y") {
+            config.yNumber = number;
+        } else if (key == "start") {
+            config.startNumber = std::max<uint64_t>(number, 1);
+        } else if (key == "chunk") {
+            config.chunkSize = std::max<uint64_t>(number, 1);
+        } else if (key == "segment") {
+            config.segmentSize = std::clamp<uint64_t>(number, 64, 1 << 26);
+        } else if (key == "flush_ms") {
+            config.flushMillis = static_cast<int>(std::clamp<uint64_t>(number, 1, 60 * 1000));
+        } else if (key == "segment_cache") {
+            config.segmentCacheSize = std::max<uint64_t>(number, 1);
+        } else if (key == "reorder_window") {
+            config.reorderWindow = static_cast<size_t>(std::clamp<uint64_t>(number, 1, 1 << 20));
+        } else if (key == "lease") {
+            config.leaseSize = std::max<uint64_t>(number, 1);
+        } else if (key == "lease_timeout_ms") {
+            config.leaseTimeoutMillis = static_cast<int>(std::clamp<uint64_t>(number, 100, 3600 * 1000));
+        } else if (key == "spawn") {
+            config.spawnWorkers = static_cast<int>(std::min<uint64_t>(number, 1024));
+        } else if (key == "trace_events") {
+            config.traceEvents = static_cast<size_t>(std::clamp<uint64_t>(number, 1024, 1 << 24));
+        } else if (key == "sieve_limit") {
+            config.sieveLimit = std::clamp<uint64_t>(number, 256, 1 << 26);
+        } else if (key == "checkpoint_ms") {
+            config.checkpointMillis = static_cast<int>(std::clamp<uint64_t>(number, 100, 24 * 3600 * 1000));
+        }
+    }
+
+    if (config.xNumThreads < 1) {
+        std::cerr << "Error: x must be at least 1!" << std::endl;
+        return false;
+    }
+
+    if (config.outputFormat == OutputFormat::U32 && config.yNumber > UINT32_MAX) {
+        std::cerr << "Error: format=u32 needs y below 2^32!" << std::endl;
+        return false;
+    }
+
+#ifdef _WIN32
+    if (config.outputFormat != OutputFormat::Text && config.outputFormat != OutputFormat::Reduce) {
+        std::cerr << "Error: binary output formats need pwrite and mmap!" << std::endl;
+        return false;
+    }
+#endif
+
+    return true;
+}
@@ -0,0 +1,337 @@
+/**
+ * Pipelined worker pool for B2: the search is linear, the threads split the divisibility test of
+ * each number.
+ *
+ * The pipeline has three stages:
+ *  1. The producer, the thread calling search(), walks the range on a wheel of 30, so multiples of
+ *     2, 3 and 5 are never candidates. It queues the candidates in batches, one job per slice of a
+ *     candidate's prime divisors, and stays up to BATCHES_PER_WORKER batches per worker ahead.
+ *  2. The workers test their slice against the shared table of primes up to 2^16 and their magic
+ *     numbers, stopping early once another slice has found a factor.
+ *  3. The worker finishing a batch commits every finished batch that is next in line, so the primes
+ *     reach the print policy in ascending order while later batches are still being tested. It
+ *     reports them under its own thread ID, so a print policy's per-thread state, such as an
+ *     output ring, is only ever written by the thread it belongs to.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "metrics.h"
+#include "primality.h"
+#include "timing.h"
+#include "topology.h"
+#include "trace.h"
+
+// Candidates the producer queues together
+const int CANDIDATES_PER_BATCH = 1024;
+// Batches in flight per worker before the producer waits for the commit stage
+const int BATCHES_PER_WORKER = 2;
+// Smallest divisor slice worth giving to a separate worker
+const int MIN_SLICE_SIZE = 64;
+// How many divisors a worker tests between checks of the cancellation flag
+const int CANCEL_POLL_INTERVAL = 64;
+// From here on a number goes through Miller-Rabin instead of being divided by every prime up to sqrt(n)
+const uint64_t MILLER_RABIN_THRESHOLD = 1ULL << 32;
+// The wheel already skips multiples of 2, 3 and 5, the first three entries of the prime table
+const uint32_t FIRST_WHEEL_DIVISOR = 3;
+
+struct CandidateBatch;
+
+// Divisibility state of one number, shared by the workers testing its slices
+struct NumberTask {
+    uint64_t n = 0;
+    std::atomic<bool> composite{false};
+    std::atomic<int> pendingSlices{0};
+    // Set by the worker finishing the last slice, when it finds a prime
+    TimePoint foundTime;
+};
+
+// One worker's share of a number: the prime divisors at table indices firstIndex..lastIndex
+struct DivisibilityJob {
+    NumberTask* task;
+    uint32_t firstIndex;
+    uint32_t lastIndex;
+    CandidateBatch* batch;
+};
+
+struct CandidateBatch {
+    explicit CandidateBatch(size_t size) : tasks(size) {}
+
+    std::vector<NumberTask> tasks;
+    std::atomic<size_t> pendingJobs{0};
+    bool finished = false;
+};
+
+// Lock the mutex, adding any time spent waiting for another thread to the caller's waitedNanos,
+// and to its trace if it has one
+inline std::unique_lock<std::mutex> lockCounted(std::mutex& mutex, long long& waitedNanos,
+                                                ThreadTrace* trace = nullptr) {
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        auto waitStart = std::chrono::steady_clock::now();
+        lock.lock();
+        auto waited = std::chrono::steady_clock::now() - waitStart;
+        waitedNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count();
+        if (trace != nullptr) trace->span(TraceKind::LockWait, traceTicks(waitStart));
+    }
+    return lock;
+}
+
+// Test the prime divisors at table indices firstIndex..lastIndex, returns how many were tested
+inline uint64_t checkDivisibility(NumberTask& task, uint32_t firstIndex, uint32_t lastIndex) {
+    const uint64_t* magic = primeMagicTable().magic.data();
+    uint32_t n = static_cast<uint32_t>(task.n);
+    uint64_t tested = 0;
+
+    // test a block of divisors at a time with the vectorized kernel
+    for (uint32_t block = firstIndex; block <= lastIndex; block += CANCEL_POLL_INTERVAL) {
+        // stop early once another worker has found a factor of this number
+        if (task.composite.load(std::memory_order_relaxed)) break;
+
+        uint32_t count = std::min<uint32_t>(CANCEL_POLL_INTERVAL, lastIndex - block + 1);
+        tested += count;
+        if (divisibleByAny(n, magic + block, count)) {
+            task.composite.store(true, std::memory_order_relaxed);
+            break;
+        }
+    }
+    return tested;
+}
+
+// Split the prime divisors up to sqrt(n) into contiguous slices, one per worker at most
+inline void addNumberJobs(NumberTask& task, CandidateBatch& batch, int numThreads, std::vector<DivisibilityJob>& jobs) {
+    if (task.n >= MILLER_RABIN_THRESHOLD) {
+        task.pendingSlices.store(1, std::memory_order_relaxed);
+        jobs.push_back({&task, 1, 0, &batch});
+        return;
+    }
+
+    const std::vector<uint32_t>& primes = primeMagicTable().primes;
+    uint32_t limit = static_cast<uint32_t>(integerSqrt(task.n));
+    uint32_t end = static_cast<uint32_t>(std::upper_bound(primes.begin(), primes.end(), limit) - primes.begin());
+    end = std::max(end, FIRST_WHEEL_DIVISOR);
+    int numDivisors = static_cast<int>(end - FIRST_WHEEL_DIVISOR);
+    int numSlices = std::clamp((numDivisors + MIN_SLICE_SIZE - 1) / MIN_SLICE_SIZE, 1, numThreads);
+    int sliceSize = (numDivisors + numSlices - 1) / numSlices;
+
+    task.pendingSlices.store(numSlices, std::memory_order_relaxed);
+    for (int i = 0; i < numSlices; ++i) {
+        uint32_t first = FIRST_WHEEL_DIVISOR + i * sliceSize;
+        uint32_t last = std::min<uint32_t>(first + sliceSize, end) - 1;
+        // a number without divisors to test still gets an empty job, which reports it
+        jobs.push_back({&task, first, last, &batch});
+    }
+}
+
+// Fixed set of worker threads created once per run, fed through a job queue. Each worker counts
+// into its own entry of metrics, the thread calling search() into submitterWaitNanos.
+template <class PrintPolicy>
+class DivisibilityPool {
+public:
+    DivisibilityPool(const Config& config, PrintPolicy& print, std::vector<ThreadMetrics>& metrics,
+                     long long& submitterWaitNanos)
+        : print(print), metrics(metrics), submitterWaitNanos(submitterWaitNanos), submitterTrace(mainTrace(config)),
+          maxBatches(static_cast<size_t>(BATCHES_PER_WORKER) * config.xNumThreads) {
+        // build the table before any worker needs it
+        primeMagicTable();
+        std::vector<Placement> placements = placeThreads(config.affinity, config.xNumThreads);
+        for (int i = 0; i < config.xNumThreads; ++i) {
+            if (submitterTrace != nullptr) submitterTrace->instant(TraceKind::Spawn, i);
+            workers.emplace_back(&DivisibilityPool::workerLoop, this, i, placements[i], config.perfCounters,
+                                 threadTrace(config, i));
+        }
+    }
+
+    ~DivisibilityPool() {
+        {
+            auto lock = lockCounted(queueMutex, submitterWaitNanos, submitterTrace);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        int64_t joinStarted = traceNow();
+        for (auto &t : workers) t.join();
+        if (submitterTrace != nullptr) submitterTrace->span(TraceKind::Join, joinStarted);
+    }
+
+    int size() const { return static_cast<int>(workers.size()); }
+
+    // Producer stage: queue the wheel candidates of [first, last] and return once all are committed
+    void search(uint64_t first, uint64_t last) {
+        std::vector<uint64_t> candidates;
+        candidates.reserve(CANDIDATES_PER_BATCH);
+
+        // 2, 3 and 5 are the only primes the wheel skips
+        for (uint64_t small : {2, 3, 5}) {
+            if (small >= first && small <= last) candidates.push_back(small);
+        }
+
+        uint64_t n;
+        int step;
+        if (firstWheelCandidate(first, n, step)) {
+            while (n <= last) {
+                candidates.push_back(n);
+                if (candidates.size() == static_cast<size_t>(CANDIDATES_PER_BATCH)) flush(candidates);
+                if (last - n < WHEEL_STEPS[step]) break;
+                n += WHEEL_STEPS[step];
+                step = (step + 1) % 8;
+            }
+        }
+        flush(candidates);
+
+        // wait for the commit stage to catch up
+        auto lock = lockCounted(commitMutex, submitterWaitNanos, submitterTrace);
+        committed.wait(lock, [this] { return batches.empty(); });
+    }
+
+private:
+    // Gaps between the numbers coprime to 30, from 1: 7, 11, 13, 17, 19, 23, 29, 31, ...
+    static constexpr uint64_t WHEEL_STEPS[8] = {6, 4, 2, 4, 2, 4, 6, 2};
+
+    // The first number from 7 on that is coprime to 30 and at least first, and the wheel step after it
+    static bool firstWheelCandidate(uint64_t first, uint64_t& n, int& step) {
+        n = std::max<uint64_t>(first, 7) / 30 * 30 + 1;
+        step = 0;
+        while (n < std::max<uint64_t>(first, 7)) {
+            if (UINT64_MAX - n < WHEEL_STEPS[step]) return false;
+            n += WHEEL_STEPS[step];
+            step = (step + 1) % 8;
+        }
+        return true;
+    }
+
+    // Queue one batch, waiting while too many are in flight
+    void flush(std::vector<uint64_t>& candidates) {
+        if (candidates.empty()) return;
+
+        auto owned = std::make_unique<CandidateBatch>(candidates.size());
+        CandidateBatch& batch = *owned;
+        std::vector<DivisibilityJob> jobs;
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            batch.tasks[i].n = candidates[i];
+            addNumberJobs(batch.tasks[i], batch, size(), jobs);
+        }
+        batch.pendingJobs.store(jobs.size(), std::memory_order_relaxed);
+        uint64_t batchStart = candidates.front();
+        candidates.clear();
+
+        {
+            auto lock = lockCounted(commitMutex, submitterWaitNanos, submitterTrace);
+            if (batches.size() >= maxBatches) {
+                // the pipeline is full until the commit stage writes out the oldest batch
+                int64_t waitStarted = traceNow();
+                committed.wait(lock, [this] { return batches.size() < maxBatches; });
+                if (submitterTrace != nullptr) submitterTrace->span(TraceKind::OutputWait, waitStarted, batchStart);
+            }
+            batches.push_back(std::move(owned));
+        }
+
+        // Queue all jobs under a single lock so workers are woken once per batch
+        {
+            auto lock = lockCounted(queueMutex, submitterWaitNanos, submitterTrace);
+            queue.insert(queue.end(), jobs.begin(), jobs.end());
+        }
+        queueCondition.notify_all();
+    }
+
+    void workerLoop(int threadID, Placement placement, bool perfCounters, ThreadTrace* trace) {
+        int64_t started = traceNow();
+        ThreadMetrics& counters = metrics[threadID];
+        pinWorker(placement, counters);
+        PerfCounters perf(perfCounters);
+
+        while (true) {
+            DivisibilityJob job;
+            {
+                auto lock = lockCounted(queueMutex, counters.lockWaitNanos, trace);
+                if (!stopping && queue.empty()) {
+                    // out of work until the next batch is queued
+                    auto idleStart = std::chrono::steady_clock::now();
+                    queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+                    counters.idleNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - idleStart).count();
+                    if (trace != nullptr) trace->span(TraceKind::Idle, traceTicks(idleStart));
+                }
+                if (queue.empty()) break;
+                job = queue.front();
+                queue.pop_front();
+            }
+
+            NumberTask& task = *job.task;
+            if (task.n >= MILLER_RABIN_THRESHOLD) {
+                // far too many divisors to test one by one, a single worker runs Miller-Rabin instead
+                if (!isPrime(task.n)) task.composite.store(true, std::memory_order_relaxed);
+            } else if (job.firstIndex <= job.lastIndex) {
+                counters.divisionsPerformed += checkDivisibility(task, job.firstIndex, job.lastIndex);
+            }
+
+            // the worker finishing the last slice of a number decides it
+            if (task.pendingSlices.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                ++counters.candidatesTested;
+                if (!task.composite.load(std::memory_order_relaxed)) {
+                    task.foundTime = Clock::now();
+                    ++counters.primesFound;
+                    if (trace != nullptr) trace->prime(traceNow(), task.n);
+                }
+            }
+
+            if (job.batch->pendingJobs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                commitFinished(*job.batch, threadID, counters, trace);
+            }
+        }
+
+        counters.perf = perf.read();
+        if (trace != nullptr) trace->span(TraceKind::Thread, started);
+    }
+
+    // Commit stage: report the primes of every finished batch at the front, in order. Only one
+    // thread commits at a time, and it reports the primes as its own whichever worker decided them.
+    void commitFinished(CandidateBatch& finishedBatch, int threadID, ThreadMetrics& counters, ThreadTrace* trace) {
+        auto lock = lockCounted(commitMutex, counters.lockWaitNanos, trace);
+        int64_t began = traceNow();
+        finishedBatch.finished = true;
+
+        uint64_t committedBatches = 0;
+        while (!batches.empty() && batches.front()->finished) {
+            for (const NumberTask& task : batches.front()->tasks) {
+                if (!task.composite.load(std::memory_order_relaxed)) {
+                    print.primeFound(threadID, task.n, task.foundTime);
+                }
+            }
+            batches.pop_front();
+            ++committedBatches;
+        }
+        if (committedBatches == 0) return;
+        committed.notify_all();
+        if (trace != nullptr) trace->span(TraceKind::Commit, began, committedBatches);
+    }
+
+    PrintPolicy& print;
+    std::vector<ThreadMetrics>& metrics;
+    long long& submitterWaitNanos;
+    ThreadTrace* submitterTrace;
+    std::vector<std::thread> workers;
+
+    std::deque<DivisibilityJob> queue;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping = false;
+
+    // batches in flight, oldest first
+    size_t maxBatches;
+    std::deque<std::unique_ptr<CandidateBatch>> batches;
+    std::mutex commitMutex;
+    std::condition_variable committed;
+};
@@ -0,0 +1,272 @@
+/**
+ * Division policies, picked at compile time by the engine:
+ * B1. StraightDivision splits the search range between the threads, each sieving its own share.
+ * B2. LinearDivision walks the range in order and splits each number's prime divisors between the threads.
+ *
+ * search() runs the whole range, reporting primes to the print policy, and returns once every
+ * worker has stopped.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "checkpoint.h"
+#include "config.h"
+#include "divisibility_pool.h"
+#include "metrics.h"
+#include "primality.h"
+#include "prime_cache.h"
+#include "sieve.h"
+#include "timing.h"
+#include "topology.h"
+#include "trace.h"
+
+// What a division policy measured besides the primes, printed after the timing summary
+struct SearchReport {
+    // When each thread ran out of work, used to report idle time until the last thread is done
+    std::vector<TimePoint> threadFinishTimes;
+    TimePoint joinTime;
+    // Time spent blocked on a mutex held by another thread, if the policy takes any locks
+    long long contendedNanos = -1;
+    RunMetrics metrics;
+};
+
+class StraightDivision {
+public:
+    static constexpr const char* NAME = "straight";
+
+    template <class PrintPolicy>
+    static void search(const Config& config, PrintPolicy& print, SearchReport& report) {
+        SegmentSieve sieve(config.yNumber, config.sieveLimit);
+        search(config, sieve, print, report);
+    }
+
+    // Search with base primes sieved beforehand, as the calibration samples of x=auto do
+    template <class PrintPolicy>
+    static void search(const Config& config, const SegmentSieve& sieve, PrintPolicy& print, SearchReport& report) {
+        std::atomic<uint64_t> nextChunk{0};
+        report.threadFinishTimes.assign(config.xNumThreads, Clock::now());
+        std::vector<ThreadMetrics>& metrics = report.metrics.threads;
+
+        std::vector<std::thread> threads;
+        uint64_t startNumber = config.startNumber, yNumber = config.yNumber;
+        uint64_t rangeSize = (yNumber - startNumber + 1) / config.xNumThreads;
+        uint64_t segmentSize = segmentSizeFor(config);
+        uint64_t chunkSize = chunkSizeFor(config, segmentSize);
+        std::vector<Placement> placements = placeThreads(config.affinity, config.xNumThreads);
+        ThreadTrace* spawner = mainTrace(config);
+
+        PrimeCache cacheFile;
+        PrimeCache* cache = nullptr;
+        if (!config.cachePath.empty() && cacheFile.open(config.cachePath)) {
+            cache = &cacheFile;
+
+            // only a search reaching the end of the cache extends it, so the cached range stays
+            // contiguous. cachedEnd itself is a multiple of 30, so starting right after it skips no prime.
+            // The bytes whose 30 numbers all lie within the search are recorded.
+            uint64_t wholeBytes = (yNumber == UINT64_MAX) ? yNumber / 30 : (yNumber + 1) / 30;
+            // a resumed run skips the chunks its checkpoint covers, so it records nothing from the
+            // first of them on, or their bytes would be published empty
+            if (config.resumeFrom != nullptr && !config.resumeFrom->ranges.empty()) {
+                wholeBytes = std::min(wholeBytes, config.resumeFrom->ranges.front().start / 30);
+            }
+            if (startNumber <= cache->cachedEnd() + 1) {
+                cache->extend(std::min(wholeBytes, PRIME_CACHE_MAX_END / 30));
+            }
+        }
+
+        if (config.dynamicScheduling) {
+            // threads claim small chunks as they go so none is left with the most expensive slice
+            for (int i = 0; i < config.xNumThreads; ++i) {
+                if (spawner != nullptr) spawner->instant(TraceKind::Spawn, i);
+                threads.emplace_back([&, i] {
+                    int64_t started = traceNow();
+                    ThreadTrace* trace = threadTrace(config, i);
+                    // pinned before anything is allocated, so the thread's memory is on its node
+                    pinWorker(placements[i], metrics[i]);
+                    PerfCounters perf(config.perfCounters);
+                    searchPrimeChunks(sieve, cache, print, nextChunk, startNumber, yNumber, chunkSize, segmentSize,
+                                      config.resumeFrom.get(), i, metrics[i], trace);
+                    metrics[i].perf = perf.read();
+                    report.threadFinishTimes[i] = Clock::now();
+                    if (trace != nullptr) trace->span(TraceKind::Thread, started);
+                });
+            }
+        } else {
+            // get the start and end index for each thread
+            for (int i = 0; i < config.xNumThreads; ++i) {
+                uint64_t start = startNumber + i * rangeSize;
+                uint64_t end = (i == config.xNumThreads - 1) ? yNumber : start + rangeSize - 1;
+                if (spawner != nullptr) spawner->instant(TraceKind::Spawn, i);
+                threads.emplace_back([&, start, end, i] {
+                    int64_t started = traceNow();
+                    ThreadTrace* trace = threadTrace(config, i);
+                    pinWorker(placements[i], metrics[i]);
+                    PerfCounters perf(config.perfCounters);
+                    searchPrimeNumbers(sieve, cache, print, start, end, segmentSize, i, metrics[i], trace);
+                    metrics[i].perf = perf.read();
+                    report.threadFinishTimes[i] = Clock::now();
+                    if (trace != nullptr) trace->span(TraceKind::Thread, started);
+                });
+            }
+        }
+
+        int64_t joinStarted = traceNow();
+        for (auto& t : threads) {
+            t.join();
+        }
+        report.joinTime = Clock::now();
+        if (spawner != nullptr) spawner->span(TraceKind::Join, joinStarted);
+
+        if (cache != nullptr) cache->commit();
+
+        for (int i = 0; i < config.xNumThreads; ++i) {
+            metrics[i].idleNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                report.joinTime - report.threadFinishTimes[i]).count();
+        }
+    }
+
+    // Static scheduling: the thread owns the fixed slice [start, end]. Lease workers search their
+    // leases through this too.
+    template <class PrintPolicy>
+    static void searchPrimeNumbers(const SegmentSieve& sieve, PrimeCache* cache, PrintPolicy& print,
+                                   uint64_t start, uint64_t end, uint64_t segmentSize, int id,
+                                   ThreadMetrics& metrics, ThreadTrace* trace = nullptr) {
+        std::vector<char> segment(segmentSize);
+        if (start <= end) {
+            int64_t began = traceNow();
+            print.reserve(id, estimatePrimeCount(start, end));
+            sieveRange(sieve, cache, print, start, end, id, segment, metrics, trace);
+            print.rangeSearched(id, start, end);
+            if (trace != nullptr) trace->span(TraceKind::Slice, began, start, end);
+        }
+    }
+
+private:
+    // Report the primes of [start, end] from the cache, step numbers at a time
+    template <class PrintPolicy>
+    static void readCachedRange(const PrimeCache& cache, PrintPolicy& print, uint64_t start, uint64_t end,
+                                uint64_t step, int id, ThreadMetrics& metrics, ThreadTrace* trace) {
+        for (uint64_t low = start; ; low += step) {
+            uint64_t high = (end - low < step) ? end : low + step - 1;
+            TimePoint foundTime = Clock::now();
+            int64_t tick = traceNow();
+
+            uint64_t primesFound = 0;
+            cache.forEachPrime(low, high, [&](uint64_t prime) {
+                print.primeFound(id, prime, foundTime);
+                if (trace != nullptr) trace->prime(tick, prime);
+                ++primesFound;
+            });
+            metrics.primesFound += primesFound;
+            if (trace != nullptr) trace->span(TraceKind::Segment, tick, low, primesFound);
+            metrics.candidatesTested += high - low + 1;
+
+            if (high == end) break;
+        }
+    }
+
+    // Sieve [start, end] one segment at a time, stamping the primes of a segment once it is sieved.
+    // With a cache, the part it already holds is read instead and new primes below its end are recorded.
+    template <class PrintPolicy>
+    static void sieveRange(const SegmentSieve& sieve, PrimeCache* cache, PrintPolicy& print, uint64_t start,
+                           uint64_t end, int id, std::vector<char>& segment, ThreadMetrics& metrics,
+                           ThreadTrace* trace) {
+        uint64_t recordEnd = 0;
+        if (cache != nullptr) {
+            if (start < cache->cachedEnd()) {
+                uint64_t cachedLast = std::min(end, cache->cachedEnd() - 1);
+                readCachedRange(*cache, print, start, cachedLast, segment.size(), id, metrics, trace);
+                if (cachedLast == end) return;
+                start = cachedLast + 1;
+            }
+            recordEnd = cache->extendedEnd();
+        }
+
+        uint64_t segmentSize = segment.size();
+        for (uint64_t low = start; ; low += segmentSize) {
+            uint64_t high = (end - low < segmentSize) ? end : low + segmentSize - 1;
+            int64_t began = traceNow();
+            metrics.divisionsPerformed += sieve.sieveSegment(low, high, segment);
+            metrics.candidatesTested += high - low + 1;
+            TimePoint foundTime = Clock::now();
+            // the primes of a segment share one tick, like they share foundTime
+            int64_t tick = (trace != nullptr) ? traceNow() : 0;
+
+            uint64_t primesFound = 0;
+            for (uint64_t k = 0; k <= high - low; ++k) {
+                uint64_t i = low + k;
+                if (segment[k] && sieve.isSurvivorPrime(i)) {
+                    print.primeFound(id, i, foundTime);
+                    if (trace != nullptr) trace->prime(tick, i);
+                    ++primesFound;
+                    if (i < recordEnd) cache->markPrime(i, low, high);
+                }
+            }
+            metrics.primesFound += primesFound;
+            if (trace != nullptr) trace->span(TraceKind::Segment, began, low, primesFound);
+
+            if (high == end) break;
+        }
+    }
+
+    // Dynamic scheduling: the thread keeps claiming the next chunk until the range is exhausted
+    template <class PrintPolicy>
+    static void searchPrimeChunks(const SegmentSieve& sieve, PrimeCache* cache, PrintPolicy& print,
+                                  std::atomic<uint64_t>& nextChunk,
+                                  uint64_t rangeStart, uint64_t rangeEnd, uint64_t chunkSize,
+                                  uint64_t segmentSize, const Checkpoint* resumed, int id,
+                                  ThreadMetrics& metrics, ThreadTrace* trace) {
+        // counted in chunks rather than numbers so the cursor cannot wrap around near 2^64
+        uint64_t numChunks = (rangeEnd - rangeStart) / chunkSize + 1;
+
+        std::vector<char> segment(segmentSize);
+        while (true) {
+            uint64_t chunk = nextChunk.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= numChunks) break;
+            uint64_t chunkStart = rangeStart + chunk * chunkSize;
+            uint64_t chunkEnd = (rangeEnd - chunkStart < chunkSize) ? rangeEnd : chunkStart + chunkSize - 1;
+            // searched before the run was stopped
+            if (resumed != nullptr && resumed->covers(chunkStart, chunkEnd)) continue;
+
+            int64_t claimed = traceNow();
+            print.chunkClaimed(id, chunkStart, chunkEnd);
+            print.reserve(id, estimatePrimeCount(chunkStart, chunkEnd));
+            sieveRange(sieve, cache, print, chunkStart, chunkEnd, id, segment, metrics, trace);
+            print.rangeSearched(id, chunkStart, chunkEnd);
+            if (trace != nullptr) trace->span(TraceKind::Chunk, claimed, chunkStart, chunkEnd);
+        }
+    }
+};
+
+class LinearDivision {
+public:
+    static constexpr const char* NAME = "linear";
+
+    template <class PrintPolicy>
+    static void search(const Config& config, PrintPolicy& print, SearchReport& report) {
+        uint64_t startNumber = config.startNumber, yNumber = config.yNumber;
+        for (int i = 0; i < config.xNumThreads; ++i) {
+            print.reserve(i, estimatePrimeCount(startNumber, yNumber) / config.xNumThreads + 1);
+        }
+
+        long long submitterWaitNanos = 0;
+        {
+            // worker threads are created once and reused for every candidate
+            DivisibilityPool<PrintPolicy> pool(config, print, report.metrics.threads, submitterWaitNanos);
+            pool.search(startNumber, yNumber);
+        }
+        report.joinTime = Clock::now();
+
+        // the workers have been joined, so their counters can be read
+        report.contendedNanos = submitterWaitNanos;
+        for (const auto& metrics : report.metrics.threads) {
+            report.contendedNanos += metrics.lockWaitNanos;
+        }
+    }
+};
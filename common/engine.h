@@ -0,0 +1,247 @@
+/**
+ * The prime search engine: one code path for every combination of print policy (A1/A2)
+ * and division policy (B1/B2). Both are template parameters, so each combination is compiled
+ * into its own specialized search loop and the choice costs nothing at runtime.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <new>
+
+#include "autotune.h"
+#include "binary_output.h"
+#include "checkpoint.h"
+#include "cluster.h"
+#include "config.h"
+#include "division_policies.h"
+#include "metrics.h"
+#include "prime_count.h"
+#include "print_policies.h"
+#include "reduction_output.h"
+#include "timing.h"
+#include "topology.h"
+#include "trace.h"
+
+template <class PrintPolicy, class DivisionPolicy>
+int runSearch(const Config& config) {
+    auto start = Clock::now();
+
+    PrintPolicy print(config);
+    SearchReport report;
+    report.metrics.threads.resize(config.xNumThreads);
+    DivisionPolicy::search(config, print, report);
+
+    auto searchEnd = Clock::now();
+    // false if some of the output was lost, the policy has already said why
+    bool outputWritten = print.finish(report.metrics);
+
+    // the run is complete, there is nothing left to resume
+    if (!config.checkpointPath.empty()) {
+        std::error_code error;
+        std::filesystem::remove(config.checkpointPath, error);
+    }
+
+    auto end = Clock::now();
+    report.metrics.searchNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(searchEnd - start).count();
+    report.metrics.printNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(end - searchEnd).count();
+
+    printStartAndEnd(start, end);
+    if (config.tuned != nullptr) printTuning(config);
+    printIdleTimes(report.threadFinishTimes, report.joinTime);
+
+    if (report.contendedNanos >= 0) {
+        std::cout << "Lock contention: "
+                  << std::chrono::duration<double>(std::chrono::nanoseconds(report.contendedNanos)).count() << "s"
+                  << std::endl;
+    }
+
+    if (config.affinity != AffinityMode::None) {
+        std::vector<Placement> placements;
+        for (const auto& thread : report.metrics.threads) placements.push_back({thread.cpu, thread.node});
+        std::cout << "Affinity: " << affinityName(config.affinity) << ", " << config.xNumThreads
+                  << " threads on " << countNodes(placements) << " NUMA node(s)" << std::endl;
+    }
+
+    if (!config.metricsPath.empty() &&
+        !writeMetricsReport(config, PrintPolicy::NAME, DivisionPolicy::NAME, report.metrics)) {
+        return 1;
+    }
+
+    // rendered only now that the run is over
+    if (config.trace != nullptr && !config.trace->write(config.tracePath)) {
+        return 1;
+    }
+
+    return outputWritten ? 0 : 1;
+}
+
+template <class PrintPolicy>
+int runWithPrintPolicy(const Config& config) {
+    if (config.divisionMode == DivisionMode::Linear) {
+        return runSearch<PrintPolicy, LinearDivision>(config);
+    }
+    return runSearch<PrintPolicy, StraightDivision>(config);
+}
+
+// Count-only mode: pi(y) - pi(start - 1) from the prime-counting function, no enumeration
+inline int runCount(const Config& config) {
+    auto start = Clock::now();
+
+    // the tables grow with sqrt(y), so a y they cannot fit is refused before anything is allocated
+    uint64_t needed = PrimeCounter::memoryNeeded(config.yNumber, config.xNumThreads);
+    uint64_t available = usableMemory();
+    if (available > 0 && needed > available) {
+        std::cerr << "Error: Counting up to " << config.yNumber << " needs about " << (needed >> 20)
+                  << " MB, more than the " << (available >> 20) << " MB of memory!" << std::endl;
+        return 1;
+    }
+
+    uint64_t count;
+    try {
+        count = countPrimesUpTo(config.yNumber, config.xNumThreads);
+        if (config.startNumber > 1) count -= countPrimesUpTo(config.startNumber - 1, config.xNumThreads);
+    } catch (const std::bad_alloc&) {
+        std::cerr << "Error: Not enough memory to count up to " << config.yNumber << ", about " << (needed >> 20)
+                  << " MB are needed!" << std::endl;
+        return 1;
+    }
+
+    auto end = Clock::now();
+    std::cout << "Primes in [" << config.startNumber << ", " << config.yNumber << "]: " << count << std::endl;
+    printStartAndEnd(start, end);
+
+    if (config.verifyCount) {
+        ReductionOutput counter(config);
+        SearchReport report;
+        report.metrics.threads.resize(config.xNumThreads);
+        StraightDivision::search(config, counter, report);
+
+        uint64_t enumerated = counter.total().count;
+        if (enumerated != count) {
+            std::cerr << "Error: the enumerating search found " << enumerated << " primes!" << std::endl;
+            return 1;
+        }
+        std::cout << "Enumerating search agrees: " << enumerated << std::endl;
+    }
+
+    return 0;
+}
+
+// Checkpointed runs search whole dynamic chunks with straight division, so a checkpoint can name
+// the chunks that are done. With --resume the run takes over the stopped run's chunk size and
+// skips what its checkpoint covers.
+inline bool prepareCheckpoint(Config& config) {
+    if (config.resume && config.checkpointPath.empty()) {
+        std::cerr << "Error: --resume needs --checkpoint=PATH!" << std::endl;
+        return false;
+    }
+    if (config.checkpointPath.empty()) return true;
+
+    bool reduce = config.outputFormat == OutputFormat::Reduce;
+    if (!reduce && (config.outputFormat != OutputFormat::Text || config.printMode != PrintMode::Ordered)) {
+        std::cerr << "Error: checkpoints need format=reduce or --print=ordered!" << std::endl;
+        return false;
+    }
+    if (config.divisionMode == DivisionMode::Linear) {
+        std::cerr << "Note: checkpointed runs use straight division" << std::endl;
+        config.divisionMode = DivisionMode::Straight;
+    }
+    config.dynamicScheduling = true;
+    config.chunkSize = chunkSizeFor(config, segmentSizeFor(config));
+    if (!config.resume) return true;
+
+    auto checkpoint = std::make_shared<Checkpoint>();
+    if (!Checkpoint::load(config.checkpointPath, *checkpoint)) {
+        std::cerr << "Note: no checkpoint at " << config.checkpointPath << ", starting from the beginning" << std::endl;
+        return true;
+    }
+    if (checkpoint->startNumber != config.startNumber || checkpoint->yNumber != config.yNumber ||
+        checkpoint->output != (reduce ? ReductionOutput::NAME : OrderedPrint::NAME) || checkpoint->chunkSize == 0) {
+        std::cerr << "Error: the checkpoint at " << config.checkpointPath << " is from a different run!" << std::endl;
+        return false;
+    }
+
+    // notes go to stderr, the output is cut back to the checkpoint
+    if (!reduce && !restoreOutput(checkpoint->outputOffset)) return false;
+
+    config.chunkSize = checkpoint->chunkSize;
+    config.resumeFrom = checkpoint;
+    std::cerr << "Note: resuming from " << config.checkpointPath << std::endl;
+    return true;
+}
+
+inline int runEngine(const Config& engineConfig) {
+    Config config = engineConfig;
+    // a worker's range comes from the coordinator
+    if (config.clusterRole == ClusterRole::Worker) {
+        return runLeaseWorker(config);
+    }
+
+    if (config.yNumber < config.startNumber) {
+        std::cout << "Error: start is past y, nothing to search!" << std::endl;
+        return 1;
+    }
+
+    if (config.countOnly) {
+        return runCount(config);
+    }
+
+    if (config.clusterRole == ClusterRole::Coordinator) {
+        return runCoordinator(config);
+    }
+
+    if (config.autoTune) autoTune(config);
+    if (!prepareCheckpoint(config)) return 1;
+    // sized for the final thread count
+    if (!config.tracePath.empty()) config.trace = std::make_shared<RunTrace>(config);
+
+    // the reduction folds contiguous ranges, which linear division does not hand to one thread
+    if (config.outputFormat == OutputFormat::Reduce) {
+        if (config.divisionMode == DivisionMode::Linear) {
+            std::cout << "Note: format=reduce runs with straight division" << std::endl;
+        }
+        return runSearch<ReductionOutput, StraightDivision>(config);
+    }
+
+    // binary formats replace the text print modes. The arrays are appended in order, so like
+    // ordered printing straight division streams them in chunks.
+    if (config.outputFormat != OutputFormat::Text) {
+        if (config.outputFormat != OutputFormat::Bitset && config.divisionMode == DivisionMode::Straight &&
+            !config.dynamicScheduling) {
+            std::cout << "Note: binary arrays are written with the dynamic scheduler" << std::endl;
+            Config chunked = config;
+            chunked.dynamicScheduling = true;
+            return runWithPrintPolicy<BinaryOutput>(chunked);
+        }
+        return runWithPrintPolicy<BinaryOutput>(config);
+    }
+    if (config.printMode == PrintMode::Deferred) {
+        return runWithPrintPolicy<DeferredPrint>(config);
+    }
+    if (config.printMode == PrintMode::Ordered) {
+        // static slices would each wait for the whole slice before them, so straight division
+        // streams in chunks
+        if (config.divisionMode == DivisionMode::Straight && !config.dynamicScheduling) {
+            std::cout << "Note: ordered printing runs with the dynamic scheduler" << std::endl;
+            Config chunked = config;
+            chunked.dynamicScheduling = true;
+            return runWithPrintPolicy<OrderedPrint>(chunked);
+        }
+        return runWithPrintPolicy<OrderedPrint>(config);
+    }
+    return runWithPrintPolicy<ImmediatePrint>(config);
+}
+
+// Entry point shared by every program: start from the preset, apply the flags, read the config file
+inline int runMain(int argc, char* argv[], const char* presetName) {
+    Config config;
+    if (!applyPreset(presetName, config)) return 1;
+    if (!parseCommandLine(argc, argv, config)) return 1;
+    if (!loadConfigFile(config)) return 1;
+
+    return runEngine(config);
+}
@@ -0,0 +1,150 @@
+/**
+ * Binary protocol between the coordinator and its worker processes, spoken over TCP.
+ *
+ * A worker connects and sends LEASE_REQUEST. The coordinator answers every request and every
+ * result with a LeaseGrant: either a lease [start, end] to search, or GRANT_DONE once the whole
+ * range is committed. While searching, the worker sends LEASE_HEARTBEAT messages carrying how
+ * many numbers of the lease it has searched so far. When done it sends LEASE_RESULT, followed by
+ * a LeaseSummary and, if the grant asked for the primes, payload bytes of varint gaps, the first
+ * from the lease start.
+ *
+ *   worker:      u32 type, u32 reserved, u64 leaseId, u64 progress, u64 payload
+ *   coordinator: u32 status, u32 wantPrimes, u32 heartbeatMillis, u32 reserved,
+ *                u64 leaseId, u64 start, u64 end, u64 y
+ *
+ * All fields are little-endian (the native order on every supported platform).
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "query_protocol.h"
+#include "prime_summary.h"
+
+const uint32_t LEASE_REQUEST = 1;
+const uint32_t LEASE_HEARTBEAT = 2;
+const uint32_t LEASE_RESULT = 3;
+
+const uint32_t GRANT_LEASE = 0;
+const uint32_t GRANT_DONE = 1;
+
+struct LeaseMessage {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t leaseId;
+    uint64_t progress;
+    uint64_t payload;
+};
+static_assert(sizeof(LeaseMessage) == 32, "worker messages are 32 bytes on the wire");
+
+struct LeaseGrant {
+    uint32_t status;
+    uint32_t wantPrimes;
+    uint32_t heartbeatMillis;
+    uint32_t reserved;
+    uint64_t leaseId;
+    uint64_t start;
+    uint64_t end;
+    uint64_t y;
+};
+static_assert(sizeof(LeaseGrant) == 48, "grants are 48 bytes on the wire");
+
+// PrimeSummary on the wire, the 128-bit sum split into two halves
+struct LeaseSummary {
+    uint64_t count;
+    uint64_t sumLow;
+    uint64_t sumHigh;
+    uint64_t first;
+    uint64_t last;
+    uint64_t largestGap;
+    uint64_t gapStart;
+    uint64_t twinPairs;
+
+    static LeaseSummary from(const PrimeSummary& summary) {
+        return {summary.count, static_cast<uint64_t>(summary.sum), static_cast<uint64_t>(summary.sum >> 64),
+                summary.first, summary.last, summary.largestGap, summary.gapStart, summary.twinPairs};
+    }
+
+    PrimeSummary toSummary() const {
+        PrimeSummary summary;
+        summary.count = count;
+        summary.sum = (static_cast<unsigned __int128>(sumHigh) << 64) | sumLow;
+        summary.first = first;
+        summary.last = last;
+        summary.largestGap = largestGap;
+        summary.gapStart = gapStart;
+        summary.twinPairs = twinPairs;
+        return summary;
+    }
+};
+static_assert(sizeof(LeaseSummary) == 64, "summaries are 64 bytes on the wire");
+
+#ifndef _WIN32
+// Resolve "host:port", false if it has no port or the host is unknown
+inline bool resolveEndpoint(const std::string& endpoint, bool passive, addrinfo*& result) {
+    size_t colon = endpoint.rfind(':');
+    if (colon == std::string::npos || colon + 1 == endpoint.size()) return false;
+    std::string host = endpoint.substr(0, colon), port = endpoint.substr(colon + 1);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (passive) hints.ai_flags = AI_PASSIVE;
+    return ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) == 0;
+}
+
+// Listening TCP socket on endpoint, or -1
+inline int listenOnEndpoint(const std::string& endpoint) {
+    addrinfo* addresses = nullptr;
+    if (!resolveEndpoint(endpoint, true, addresses)) return -1;
+
+    int fd = -1;
+    for (addrinfo* address = addresses; address != nullptr && fd < 0; address = address->ai_next) {
+        fd = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) continue;
+        int reuse = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (::bind(fd, address->ai_addr, address->ai_addrlen) != 0 || ::listen(fd, 128) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    ::freeaddrinfo(addresses);
+    return fd;
+}
+
+// Connected TCP socket to endpoint, or -1
+inline int connectToEndpoint(const std::string& endpoint) {
+    addrinfo* addresses = nullptr;
+    if (!resolveEndpoint(endpoint, false, addresses)) return -1;
+
+    int fd = -1;
+    for (addrinfo* address = addresses; address != nullptr && fd < 0; address = address->ai_next) {
+        fd = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) continue;
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    ::freeaddrinfo(addresses);
+
+    // messages are small and each one is waited for, so send them right away
+    if (fd >= 0) {
+        int noDelay = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+    return fd;
+}
+#endif
@@ -0,0 +1,222 @@
+/**
+ * Per-thread counters for a run and their export as a JSON or CSV report.
+ *
+ * Each worker only writes its own ThreadMetrics, kept on its own cache line, so counting
+ * needs no atomics. The report is read once every worker has stopped.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "config.h"
+
+// Hardware counters of one thread, filled in only when --perf is given and the kernel allows it
+struct PerfSample {
+    bool valid = false;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cacheMisses = 0;
+};
+
+// Counts cycles, instructions and cache misses of the calling thread between construction and read()
+class PerfCounters {
+public:
+    explicit PerfCounters(bool enabled) {
+#ifdef __linux__
+        if (!enabled) return;
+        const uint64_t events[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+        for (int i = 0; i < 3; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = events[i];
+            attr.disabled = (i == 0);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            // pid 0 and cpu -1 follow the calling thread wherever it is scheduled
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, (i == 0) ? -1 : fds[0], 0));
+            if (fds[i] < 0) {
+                close();
+                return;
+            }
+        }
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+        (void)enabled;
+#endif
+    }
+
+    ~PerfCounters() { close(); }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    PerfSample read() {
+        PerfSample sample;
+#ifdef __linux__
+        if (fds[0] < 0) return sample;
+        ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        uint64_t values[4] = {}; // event count followed by one value per event
+        if (::read(fds[0], values, sizeof(values)) == static_cast<ssize_t>(sizeof(values)) && values[0] == 3) {
+            sample = {true, values[1], values[2], values[3]};
+        }
+#endif
+        return sample;
+    }
+
+private:
+    void close() {
+#ifdef __linux__
+        for (int& fd : fds) {
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+#endif
+    }
+
+    int fds[3] = {-1, -1, -1};
+};
+
+struct alignas(64) ThreadMetrics {
+    uint64_t candidatesTested = 0;
+    // trial divisions for linear division, composites crossed off for straight division
+    uint64_t divisionsPerformed = 0;
+    uint64_t primesFound = 0;
+    // blocked on a mutex held by another thread
+    long long lockWaitNanos = 0;
+    // blocked on a full output ring until the writer thread caught up
+    long long outputWaitNanos = 0;
+    // out of work, either waiting for jobs or waiting for the slowest thread to finish
+    long long idleNanos = 0;
+    // where the thread was pinned, -1 if it was left to the scheduler
+    int cpu = -1;
+    int node = -1;
+    PerfSample perf;
+};
+
+struct RunMetrics {
+    std::vector<ThreadMetrics> threads;
+    long long searchNanos = 0;
+    long long printNanos = 0;
+};
+
+inline double toSeconds(long long nanos) {
+    return std::chrono::duration<double>(std::chrono::nanoseconds(nanos)).count();
+}
+
+inline const char* affinityName(AffinityMode affinity) {
+    switch (affinity) {
+        case AffinityMode::Compact: return "compact";
+        case AffinityMode::Scatter: return "scatter";
+        default: return "none";
+    }
+}
+
+inline std::string metricsFormat(const std::string& path) {
+    return (path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0) ? "csv" : "json";
+}
+
+inline void writeMetricsJson(std::ostream& out, const Config& config, const char* printName,
+                             const char* divisionName, const RunMetrics& metrics) {
+    ThreadMetrics total;
+    for (const auto& thread : metrics.threads) {
+        total.candidatesTested += thread.candidatesTested;
+        total.divisionsPerformed += thread.divisionsPerformed;
+        total.primesFound += thread.primesFound;
+        total.lockWaitNanos += thread.lockWaitNanos;
+        total.outputWaitNanos += thread.outputWaitNanos;
+        total.idleNanos += thread.idleNanos;
+    }
+
+    auto writeCounters = [&out](const ThreadMetrics& thread) {
+        out << "\"candidatesTested\": " << thread.candidatesTested
+            << ", \"divisionsPerformed\": " << thread.divisionsPerformed
+            << ", \"primesFound\": " << thread.primesFound
+            << ", \"lockWaitSeconds\": " << toSeconds(thread.lockWaitNanos)
+            << ", \"outputWaitSeconds\": " << toSeconds(thread.outputWaitNanos)
+            << ", \"idleSeconds\": " << toSeconds(thread.idleNanos);
+    };
+
+    out << "{\n"
+        << "  \"print\": \"" << printName << "\",\n"
+        << "  \"division\": \"" << divisionName << "\",\n"
+        << "  \"scheduler\": \"" << (config.dynamicScheduling ? "dynamic" : "static") << "\",\n"
+        << "  \"affinity\": \"" << affinityName(config.affinity) << "\",\n"
+        << "  \"threads\": " << config.xNumThreads << ",\n"
+        << "  \"start\": " << config.startNumber << ",\n"
+        << "  \"end\": " << config.yNumber << ",\n"
+        << "  \"searchSeconds\": " << toSeconds(metrics.searchNanos) << ",\n"
+        << "  \"printSeconds\": " << toSeconds(metrics.printNanos) << ",\n"
+        << "  \"total\": {";
+    writeCounters(total);
+    out << "},\n  \"perThread\": [\n";
+
+    for (size_t i = 0; i < metrics.threads.size(); ++i) {
+        const ThreadMetrics& thread = metrics.threads[i];
+        out << "    {\"thread\": " << i << ", ";
+        writeCounters(thread);
+        if (thread.cpu >= 0) out << ", \"cpu\": " << thread.cpu << ", \"node\": " << thread.node;
+        if (thread.perf.valid) {
+            double ipc = thread.perf.cycles ? static_cast<double>(thread.perf.instructions) / thread.perf.cycles : 0.0;
+            out << ", \"cycles\": " << thread.perf.cycles << ", \"instructions\": " << thread.perf.instructions
+                << ", \"ipc\": " << ipc << ", \"cacheMisses\": " << thread.perf.cacheMisses;
+        }
+        out << "}" << (i + 1 < metrics.threads.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+inline void writeMetricsCsv(std::ostream& out, const RunMetrics& metrics) {
+    out << "thread,candidatesTested,divisionsPerformed,primesFound,lockWaitSeconds,outputWaitSeconds,"
+        << "idleSeconds,cycles,instructions,cacheMisses,cpu,node\n";
+    for (size_t i = 0; i < metrics.threads.size(); ++i) {
+        const ThreadMetrics& thread = metrics.threads[i];
+        out << i << "," << thread.candidatesTested << "," << thread.divisionsPerformed << ","
+            << thread.primesFound << "," << toSeconds(thread.lockWaitNanos) << ","
+            << toSeconds(thread.outputWaitNanos) << "," << toSeconds(thread.idleNanos) << ",";
+        if (thread.perf.valid) {
+            out << thread.perf.cycles << "," << thread.perf.instructions << "," << thread.perf.cacheMisses;
+        } else {
+            out << ",,";
+        }
+        out << ",";
+        if (thread.cpu >= 0) out << thread.cpu << "," << thread.node;
+        else out << ",";
+        out << "\n";
+    }
+}
+
+// Write the report to config.metricsPath, as CSV if it ends in .csv and JSON otherwise
+inline bool writeMetricsReport(const Config& config, const char* printName, const char* divisionName,
+                               const RunMetrics& metrics) {
+    std::ofstream out(config.metricsPath);
+    if (!out) {
+        std::cerr << "Error: Could not write metrics to " << config.metricsPath << "!" << std::endl;
+        return false;
+    }
+
+    if (metricsFormat(config.metricsPath) == "csv") {
+        writeMetricsCsv(out, metrics);
+    } else {
+        writeMetricsJson(out, config, printName, divisionName, metrics);
+    }
+    return true;
+}
@@ -0,0 +1,127 @@
+/**
+ * Primality testing: vectorized trial division below 2^32, deterministic Miller-Rabin above.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "trial_division.h"
+
+// Primes used to reject most composites with a cheap division before Miller-Rabin
+const uint64_t SMALL_PRIMES[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
+
+// With these bases Miller-Rabin has no false positives for any n below 2^64
+const uint64_t MILLER_RABIN_BASES[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+// Arithmetic modulo an odd n in Montgomery form, so modular products need no division
+struct Montgomery {
+    uint64_t n;
+    uint64_t inverse; // n^-1 mod 2^64
+    uint64_t r2;      // 2^128 mod n
+
+    explicit Montgomery(uint64_t modulus) : n(modulus), inverse(modulus) {
+        // Newton's iteration, each step doubles the number of correct low bits
+        for (int i = 0; i < 5; ++i) {
+            inverse *= 2 - n * inverse;
+        }
+        uint64_t r = (0 - n) % n; // 2^64 mod n
+        r2 = static_cast<uint64_t>(static_cast<unsigned __int128>(r) * r % n);
+    }
+
+    // t * 2^-64 mod n, for t < n * 2^64
+    uint64_t reduce(unsigned __int128 t) const {
+        uint64_t m = static_cast<uint64_t>(t) * inverse;
+        uint64_t high = static_cast<uint64_t>(t >> 64);
+        uint64_t mnHigh = static_cast<uint64_t>((static_cast<unsigned __int128>(m) * n) >> 64);
+        return high >= mnHigh ? high - mnHigh : high - mnHigh + n;
+    }
+
+    uint64_t multiply(uint64_t a, uint64_t b) const {
+        return reduce(static_cast<unsigned __int128>(a) * b);
+    }
+
+    uint64_t toMontgomery(uint64_t a) const {
+        return multiply(a % n, r2);
+    }
+
+    uint64_t power(uint64_t base, uint64_t exponent) const {
+        uint64_t result = toMontgomery(1);
+        while (exponent > 0) {
+            if (exponent & 1) result = multiply(result, base);
+            base = multiply(base, base);
+            exponent >>= 1;
+        }
+        return result;
+    }
+};
+
+// Deterministic Miller-Rabin for odd n > 53
+inline bool millerRabin(uint64_t n) {
+    Montgomery mont(n);
+    uint64_t d = n - 1;
+    int s = 0;
+    while ((d & 1) == 0) {
+        d >>= 1;
+        ++s;
+    }
+
+    uint64_t one = mont.toMontgomery(1);
+    uint64_t minusOne = mont.toMontgomery(n - 1);
+
+    for (uint64_t base : MILLER_RABIN_BASES) {
+        if (base % n == 0) continue;
+
+        uint64_t x = mont.power(mont.toMontgomery(base), d);
+        if (x == one || x == minusOne) continue;
+
+        bool composite = true;
+        for (int r = 1; r < s && composite; ++r) {
+            x = mont.multiply(x, x);
+            if (x == minusOne) composite = false;
+        }
+        if (composite) return false;
+    }
+    return true;
+}
+
+inline bool isPrime(uint64_t n) {
+    if (n <= 1) return false;
+
+    // mid-range numbers are cheaper to trial divide with the vectorized kernel
+    if (n <= UINT32_MAX) return isPrimeTrialDivision(static_cast<uint32_t>(n));
+
+    for (uint64_t p : SMALL_PRIMES) {
+        if (n % p == 0) return n == p;
+    }
+
+    // no factor up to 53, so anything below 59^2 is prime
+    if (n < 59 * 59) return true;
+    return millerRabin(n);
+}
+
+inline uint64_t integerSqrt(uint64_t n) {
+    uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<long double>(n)));
+    while (root > 0 && root * root > n) --root;
+    while (root < UINT32_MAX && (root + 1) * (root + 1) <= n) ++root;
+    return root;
+}
+
+// Upper bound on the number of primes in [start, end]. From 1 it follows pi(n) < 1.25506 * n / ln(n)
+// and pi(n) > n / ln(n) for n >= 17, for narrow windows Brun-Titchmarsh gives 2 * length / ln(length).
+inline size_t estimatePrimeCount(uint64_t start, uint64_t end) {
+    if (end < start) return 0;
+    if (end < 17) return 7;
+    double upper = 1.25506 * end / std::log(static_cast<double>(end));
+    double lower = (start > 17) ? (start - 1) / std::log(static_cast<double>(start - 1)) : 0.0;
+
+    double length = static_cast<double>(end - start) + 1;
+    if (length > 2) {
+        upper = std::min(upper - lower, 2 * length / std::log(length));
+        lower = 0.0;
+    }
+    return static_cast<size_t>(upper - lower) + 1;
+}
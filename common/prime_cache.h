@@ -0,0 +1,242 @@
+/**
+ * Persistent prime cache: a memory-mapped wheel-30 bitset of every number below some limit.
+ *
+ * Each byte covers 30 consecutive numbers and has one bit per residue coprime to 30, so the
+ * file needs one byte per 30 numbers (about 33 MB up to 10^9). 2, 3 and 5 are implicit.
+ * The 64-byte header holds the number of bitset bytes and an FNV-1a checksum of them, and is
+ * only rewritten after new bytes are complete, so an interrupted run leaves the old cache valid.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Residues mod 30 that can hold a prime above 5, one per bit of a cache byte
+const uint8_t WHEEL_RESIDUES[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+
+// Bit of a residue mod 30 within a cache byte, -1 for residues sharing a factor with 30
+const int8_t WHEEL_BIT[30] = {-1, 0, -1, -1, -1, -1, -1, 1, -1, -1, -1, 2, -1, 3, -1,
+                              -1, -1, 4, -1, 5, -1, -1, -1, 6, -1, -1, -1, -1, -1, 7};
+
+// The cache is not grown past this many numbers, a 36 GB file
+const uint64_t PRIME_CACHE_MAX_END = 1ULL << 40;
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+inline uint64_t fnv1a(const uint8_t* data, size_t length, uint64_t hash = FNV_OFFSET) {
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+struct PrimeCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t byteCount;      // bitset bytes, covering every number below 30 * byteCount
+    uint64_t checksum;       // FNV-1a of the bitset bytes
+    uint64_t headerChecksum; // FNV-1a of the fields above
+    uint8_t reserved[24];
+};
+static_assert(sizeof(PrimeCacheHeader) == 64, "the cache header is 64 bytes on disk");
+
+const char PRIME_CACHE_MAGIC[8] = {'P', 'R', 'I', 'M', 'E', 'W', '3', '0'};
+const uint32_t PRIME_CACHE_VERSION = 1;
+
+class PrimeCache {
+public:
+    PrimeCache() = default;
+    PrimeCache(const PrimeCache&) = delete;
+    PrimeCache& operator=(const PrimeCache&) = delete;
+
+    ~PrimeCache() { unmap(); closeFile(); }
+
+    // Open or create the cache at path. A cache failing validation is reported and started over.
+    bool open(const std::string& path) {
+#ifdef _WIN32
+        std::cerr << "Warning: the prime cache needs mmap, ignoring " << path << std::endl;
+        return false;
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::cerr << "Warning: Could not open prime cache " << path << ", running without it" << std::endl;
+            return false;
+        }
+
+        struct stat info;
+        fstat(fd, &info);
+        uint64_t fileSize = static_cast<uint64_t>(info.st_size);
+
+        PrimeCacheHeader onDisk;
+        bool valid = fileSize >= sizeof(PrimeCacheHeader) &&
+                     pread(fd, &onDisk, sizeof(onDisk), 0) == static_cast<ssize_t>(sizeof(onDisk)) &&
+                     validHeader(onDisk) && sizeof(PrimeCacheHeader) + onDisk.byteCount <= fileSize;
+
+        if (valid) {
+            if (!map(onDisk.byteCount)) return false;
+            valid = fnv1a(bits(), onDisk.byteCount) == onDisk.checksum;
+        }
+
+        if (!valid) {
+            if (fileSize > 0) {
+                std::cerr << "Warning: prime cache " << path << " failed validation, rebuilding it" << std::endl;
+            }
+            unmap();
+            if (ftruncate(fd, sizeof(PrimeCacheHeader)) != 0 || !map(0)) return false;
+            initHeader();
+        }
+
+        cachedBytes = header()->byteCount;
+        extendedBytes = cachedBytes;
+        return true;
+#endif
+    }
+
+    // Every number below this is in the cache
+    uint64_t cachedEnd() const { return 30 * cachedBytes; }
+
+    // Grow the bitset to cover every number below 30 * byteCount. The new bytes start out zero
+    // and are filled with markPrime, then made permanent by commit.
+    bool extend(uint64_t byteCount) {
+#ifndef _WIN32
+        if (byteCount <= cachedBytes) return true;
+        unmap();
+
+        // truncating first drops anything a failed earlier run left past the valid bytes
+        if (ftruncate(fd, sizeof(PrimeCacheHeader) + cachedBytes) != 0 ||
+            ftruncate(fd, sizeof(PrimeCacheHeader) + byteCount) != 0 || !map(byteCount)) {
+            std::cerr << "Warning: Could not grow the prime cache" << std::endl;
+            map(cachedBytes);
+            return false;
+        }
+        extendedBytes = byteCount;
+        return true;
+#else
+        (void)byteCount;
+        return false;
+#endif
+    }
+
+    uint64_t extendedEnd() const { return 30 * extendedBytes; }
+
+    // Record p as prime. Bytes lying wholly inside [low, high] belong to the calling thread,
+    // a byte straddling the edge may be shared with the neighbouring range so it is updated atomically.
+    void markPrime(uint64_t p, uint64_t low, uint64_t high) {
+        uint64_t byte = p / 30;
+        int bit = WHEEL_BIT[p % 30];
+        if (bit < 0) return;
+
+        uint8_t mask = static_cast<uint8_t>(1u << bit);
+        if (byte * 30 < low || byte * 30 + 29 > high) {
+            std::atomic_ref<uint8_t>(bits()[byte]).fetch_or(mask, std::memory_order_relaxed);
+        } else {
+            bits()[byte] |= mask;
+        }
+    }
+
+    // Call onPrime for every cached prime in [start, end], which must lie below cachedEnd()
+    template <class OnPrime>
+    void forEachPrime(uint64_t start, uint64_t end, OnPrime&& onPrime) const {
+        for (uint64_t p : {2, 3, 5}) {
+            if (p >= start && p <= end) onPrime(p);
+        }
+
+        const uint8_t* data = bits();
+        for (uint64_t byte = start / 30; byte <= end / 30; ++byte) {
+            unsigned mask = data[byte];
+            while (mask != 0) {
+                uint64_t n = byte * 30 + WHEEL_RESIDUES[__builtin_ctz(mask)];
+                mask &= mask - 1;
+                if (n >= start && n <= end) onPrime(n);
+            }
+        }
+    }
+
+    // Checksum the new bytes, then publish them by rewriting the header
+    void commit() {
+#ifndef _WIN32
+        if (extendedBytes <= cachedBytes) return;
+
+        PrimeCacheHeader* h = header();
+        uint64_t checksum = fnv1a(bits() + cachedBytes, extendedBytes - cachedBytes, h->checksum);
+        msync(mapping, mappedSize, MS_SYNC);
+
+        h->byteCount = extendedBytes;
+        h->checksum = checksum;
+        h->headerChecksum = headerChecksum(*h);
+        msync(mapping, sizeof(PrimeCacheHeader), MS_SYNC);
+        cachedBytes = extendedBytes;
+#endif
+    }
+
+private:
+    static uint64_t headerChecksum(const PrimeCacheHeader& h) {
+        return fnv1a(reinterpret_cast<const uint8_t*>(&h), offsetof(PrimeCacheHeader, headerChecksum));
+    }
+
+    static bool validHeader(const PrimeCacheHeader& h) {
+        return std::memcmp(h.magic, PRIME_CACHE_MAGIC, sizeof(h.magic)) == 0 && h.version == PRIME_CACHE_VERSION &&
+               h.headerSize == sizeof(PrimeCacheHeader) && h.headerChecksum == headerChecksum(h);
+    }
+
+    void initHeader() {
+        PrimeCacheHeader* h = header();
+        std::memset(h, 0, sizeof(PrimeCacheHeader));
+        std::memcpy(h->magic, PRIME_CACHE_MAGIC, sizeof(h->magic));
+        h->version = PRIME_CACHE_VERSION;
+        h->headerSize = sizeof(PrimeCacheHeader);
+        h->checksum = FNV_OFFSET; // checksum of no bytes
+        h->headerChecksum = headerChecksum(*h);
+    }
+
+    PrimeCacheHeader* header() const { return static_cast<PrimeCacheHeader*>(mapping); }
+    uint8_t* bits() const { return static_cast<uint8_t*>(mapping) + sizeof(PrimeCacheHeader); }
+
+    bool map(uint64_t byteCount) {
+#ifndef _WIN32
+        mappedSize = sizeof(PrimeCacheHeader) + byteCount;
+        mapping = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            return false;
+        }
+        return true;
+#else
+        (void)byteCount;
+        return false;
+#endif
+    }
+
+    void unmap() {
+#ifndef _WIN32
+        if (mapping != nullptr) munmap(mapping, mappedSize);
+        mapping = nullptr;
+#endif
+    }
+
+    void closeFile() {
+#ifndef _WIN32
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+    }
+
+    int fd = -1;
+    void* mapping = nullptr;
+    size_t mappedSize = 0;
+    uint64_t cachedBytes = 0;   // bytes covered by the header's checksum
+    uint64_t extendedBytes = 0; // bytes mapped for this run, published by commit
+};
@@ -0,0 +1,536 @@
+/**
+ * Count-only mode: pi(y) without enumerating the primes, by the Lagarias-Miller-Odlyzko method.
+ *
+ * With a leaf bound u between y^(1/3) and sqrt(y), and a = pi(u),
+ *     pi(y) = phi(y, a) + a - 1 - P2(y, a)
+ * where phi(v, b) counts the numbers up to v with none of the first b primes as a factor, and
+ * P2(y, a) counts the products of two primes above u that are at most y. phi(y, a) is expanded
+ * into leaves mu(m) phi(y / m, b) for squarefree m. The ordinary leaves have m <= u and b = 0,
+ * so each is just y / m. The special leaves have m > u and an argument below y / u. They are
+ * read from a segmented sieve of [1, y / u] that crosses off the primes up to u one at a time,
+ * with a counter per 512 numbers of what is left of the segment. Once every prime up to u is
+ * crossed off, what is left above u are the primes, which is what P2 needs.
+ * Two kinds of leaves skip the sieve: those of the first 6 primes use phi's period of 30030,
+ * and those whose argument v lies below u and below p_{b+1}^2 are 1 + pi(v) - b, read from a
+ * table of pi up to u.
+ *
+ * It takes O(y^(2/3)) time and O(y^(1/3)) memory. On one core that is
+ *     y = 10^13    0.5 s      3 MB
+ *     y = 10^15    8 s        16 MB
+ *     y = 10^16    33 s       37 MB
+ *     y = 10^17    3 min      86 MB
+ * and a few hours near 10^19, where the leaf bound stops growing. memoryNeeded() lets the caller refuse a y
+ * whose tables do not fit before allocating them.
+ *
+ * The x threads split the easy leaves by prime, then claim blocks of the sieve. A block starts
+ * counting from zero, and once every block is done the numbers left in the blocks before it are
+ * added to its leaves and to its part of P2.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "primality.h"
+
+// Below this, pi(y) is counted with a plain sieve
+const uint64_t SMALL_COUNT_LIMIT = 1 << 16;
+
+// Leaves of the first PHI_TINY_PRIMES primes are computed from phi's period, their product
+const int PHI_TINY_PRIMES = 6;
+const uint64_t PHI_TINY_PERIOD = 2 * 3 * 5 * 7 * 11 * 13;
+
+// Numbers per sieve segment, at most; segments are sized to the leaf bound below that
+const uint64_t MAX_COUNT_SEGMENT = 1 << 20;
+const uint64_t MIN_COUNT_SEGMENT = 1 << 16;
+
+// Numbers per counter of a sieve segment, as a power of two
+const uint64_t COUNTER_SHIFT = 9;
+
+// Largest leaf bound, keeping the tables up to it under 200 MB
+const uint64_t MAX_LEAF_BOUND = 1 << 24;
+
+// Sieve blocks per thread, so a thread that drew cheap blocks takes on more
+const int COUNT_BLOCKS_PER_THREAD = 8;
+
+// floor(n / p), through a double reciprocal while n is exact as a double
+inline uint64_t divideByPrime(uint64_t n, uint64_t p, double inverse, bool exactDouble) {
+    if (!exactDouble) return n / p;
+
+    uint64_t quotient = static_cast<uint64_t>(static_cast<double>(n) * inverse);
+    // the reciprocal can be off by one either way
+    if (quotient * p > n) --quotient;
+    else if ((quotient + 1) * p <= n) ++quotient;
+    return quotient;
+}
+
+// Largest c with c^3 <= n
+inline uint64_t integerCbrt(uint64_t n) {
+    uint64_t root = static_cast<uint64_t>(std::cbrt(static_cast<long double>(n)));
+    auto cube = [](uint64_t c) { return static_cast<unsigned __int128>(c) * c * c; };
+    while (root > 0 && cube(root) > n) --root;
+    while (cube(root + 1) <= n) ++root;
+    return root;
+}
+
+class PrimeCounter {
+public:
+    // Leaf bound for y: alpha * y^(1/3), with alpha growing with y as the sieve gets the costlier
+    // part, up to MAX_LEAF_BOUND
+    static uint64_t leafBound(uint64_t y) {
+        double digits = std::log10(static_cast<double>(y));
+        double alpha = std::max(1.0, 1.5 * digits - 10.0);
+        uint64_t cubeRoot = integerCbrt(y);
+        uint64_t u = std::max(cubeRoot, static_cast<uint64_t>(alpha * static_cast<double>(cubeRoot)));
+        return std::min({u, std::max(cubeRoot, MAX_LEAF_BOUND), integerSqrt(y)});
+    }
+
+    static uint64_t segmentSizeFor(uint64_t u) {
+        uint64_t size = MIN_COUNT_SEGMENT;
+        while (size < u && size < MAX_COUNT_SEGMENT) size <<= 1;
+        return size;
+    }
+
+    // Bytes of the tables for y: the tables up to the leaf bound and the primes below it, and per
+    // thread a segment with its counters and a cursor per prime. The first block's counts come
+    // on top, the other blocks only keep counts for the few primes their leaves need.
+    static uint64_t memoryNeeded(uint64_t y, int numThreads) {
+        if (y < SMALL_COUNT_LIMIT) return y + 1;
+        uint64_t u = leafBound(y);
+        uint64_t primes = static_cast<uint64_t>(1.26 * static_cast<double>(u) / std::log(static_cast<double>(u))) + 1;
+        uint64_t segment = segmentSizeFor(u);
+        uint64_t threads = static_cast<uint64_t>(std::max(numThreads, 1));
+
+        uint64_t tables = u * (2 * sizeof(int32_t) + sizeof(int8_t)) + u / 64 * sizeof(PiWord) +
+                          primes * (sizeof(uint32_t) + sizeof(double)) +
+                          PHI_TINY_PERIOD * (2 * sizeof(uint16_t) + sizeof(uint64_t));
+        uint64_t perThread = segment * sizeof(uint8_t) + segment / 64 * sizeof(uint64_t) +
+                             (segment >> COUNTER_SHIFT) * sizeof(uint32_t) +
+                             primes * (sizeof(uint64_t) + sizeof(uint32_t));
+        return tables + threads * perThread + primes * (sizeof(uint64_t) + sizeof(int64_t));
+    }
+
+    explicit PrimeCounter(uint64_t y)
+        : y(y), u(leafBound(y)), sieveEnd(y / u), root(integerSqrt(y)), exactDouble(y < (1ULL << 53)),
+          segmentSize(segmentSizeFor(u)) {}
+
+    uint64_t count(int numThreads) {
+        if (y < SMALL_COUNT_LIMIT) return countBySieve();
+
+        buildTables();
+        numThreads = std::max(numThreads, 1);
+
+        // ordinary leaves and those of the first primes, O(u) each
+        __int128 phi = 0;
+        for (uint64_t m = 1; m <= u; ++m) {
+            if (lpfMu[m] != 0) phi += mu(m) * static_cast<__int128>(y / m);
+        }
+        for (size_t b = 0; b < tinyEnd; ++b) {
+            uint64_t p = primes[b], quotient = y / p;
+            for (uint64_t m = u; m > u / p; --m) {
+                if (leastFactor(m) > p) phi -= mu(m) * static_cast<__int128>(tinyPhi(quotient / m, b));
+            }
+        }
+
+        uint64_t numSegments = (sieveEnd + segmentSize - 1) / segmentSize;
+        uint64_t numBlocks = std::min<uint64_t>(numSegments, (numThreads == 1) ? 1 : numThreads * COUNT_BLOCKS_PER_THREAD);
+        std::vector<BlockCounts> blocks(numBlocks);
+        std::vector<__int128> easySums(numThreads, 0);
+        std::atomic<size_t> nextEasy{scanEnd};
+        std::atomic<uint64_t> nextBlock{0};
+
+        auto work = [&](int id) {
+            for (size_t b; (b = nextEasy.fetch_add(1, std::memory_order_relaxed)) < primes.size();) {
+                easySums[id] += easyLeaves(b);
+            }
+            SieveWorkspace workspace;
+            for (uint64_t k; (k = nextBlock.fetch_add(1, std::memory_order_relaxed)) < numBlocks;) {
+                sieveBlock(numSegments * k / numBlocks, numSegments * (k + 1) / numBlocks, workspace, blocks[k]);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int id = 1; id < numThreads; ++id) threads.emplace_back(work, id);
+        work(0);
+        for (auto& t : threads) t.join();
+
+        for (__int128 sum : easySums) phi += sum;
+
+        // each block counted from its own start, the numbers left before it are added now
+        std::vector<uint64_t> leftBefore(primes.size(), 0);
+        uint64_t primesBefore = 0, p2Primes = 0;
+        __int128 p2 = 0;
+        for (const BlockCounts& block : blocks) {
+            phi += block.leafSum;
+            for (size_t b = tinyEnd; b < block.left.size(); ++b) {
+                phi -= block.muSums[b] * static_cast<__int128>(leftBefore[b]);
+                leftBefore[b] += block.left[b];
+            }
+            // pi(v) = a - 1 + the numbers up to v left after crossing off every prime up to u, 1 included
+            p2 += block.p2Sum + static_cast<__int128>(block.p2Primes) * (primes.size() - 1 + primesBefore);
+            p2Primes += block.p2Primes;
+            primesBefore += block.primesLeft;
+        }
+
+        // P2 pairs the k-th prime above u with the primes from it to y / p_k, so pi(p_k) - 1 comes off each
+        __int128 a = primes.size(), last = a + p2Primes;
+        p2 -= (last - 1) * last / 2 - (a - 1) * a / 2;
+        return static_cast<uint64_t>(phi + a - 1 - p2);
+    }
+
+private:
+    // What a block of the sieve found, counted from the block's start
+    struct BlockCounts {
+        // Per b: numbers left in the block once the first b primes are crossed off, and the sum of
+        // mu(m) over its leaves, which still need the numbers left before the block
+        std::vector<uint64_t> left;
+        std::vector<int64_t> muSums;
+        __int128 leafSum = 0;
+        uint64_t primesLeft = 0;
+        // Primes above u whose y / p falls in the block, and the sum of what is left up to each y / p
+        uint64_t p2Primes = 0;
+        __int128 p2Sum = 0;
+    };
+
+    // pi up to u in 16 bytes per 64 numbers, so the easy leaves' lookups mostly hit the cache
+    struct PiWord {
+        uint64_t primes; // a bit per prime
+        uint64_t before; // primes below the word
+    };
+
+    // A segment holds one bit per number, set while no prime crossed off so far divides it, and
+    // how many are set per 2^COUNTER_SHIFT numbers
+    struct SieveWorkspace {
+        std::vector<uint64_t> segment;
+        std::vector<uint32_t> counters;
+        std::vector<uint64_t> nextMultiple;
+        std::vector<uint32_t> nextLeaf;
+        std::vector<uint8_t> candidates;
+    };
+
+    uint64_t countBySieve() const {
+        if (y < 2) return 0;
+        std::vector<char> composite(y + 1, 0);
+        uint64_t count = 0;
+        for (uint64_t i = 2; i <= y; ++i) {
+            if (composite[i]) continue;
+            ++count;
+            for (uint64_t j = i * i; j <= y; j += i) composite[j] = 1;
+        }
+        return count;
+    }
+
+    // Primes up to u, pi up to u, and for every m up to u its least prime factor signed with
+    // mu(m), 0 if m is not squarefree. 1 has no prime factor and is given one above every prime.
+    void buildTables() {
+        std::vector<uint32_t> least(u + 1, 0);
+        std::vector<int8_t> mobius(u + 1, 1);
+        piTable.assign(u / 64 + 1, PiWord{0, 0});
+        for (uint64_t i = 2; i <= u; ++i) {
+            if (least[i] != 0) continue;
+            primes.push_back(static_cast<uint32_t>(i));
+            inverses.push_back(1.0 / static_cast<double>(i));
+            piTable[i / 64].primes |= 1ULL << (i % 64);
+            for (uint64_t j = i; j <= u; j += i) {
+                if (least[j] == 0) least[j] = static_cast<uint32_t>(i);
+                mobius[j] = static_cast<int8_t>(-mobius[j]);
+            }
+            for (uint64_t j = i * i; j <= u; j += i * i) mobius[j] = 0;
+        }
+
+        for (size_t w = 1; w < piTable.size(); ++w) {
+            piTable[w].before = piTable[w - 1].before + static_cast<uint64_t>(__builtin_popcountll(piTable[w - 1].primes));
+        }
+
+        lpfMu.assign(u + 1, 0);
+        lpfMu[1] = INT32_MAX;
+        for (uint64_t m = 2; m <= u; ++m) lpfMu[m] = mobius[m] * static_cast<int32_t>(least[m]);
+
+        // leaves of the primes up to sqrt(u) can have composite m and are scanned over every m,
+        // the later primes only pair with primes
+        tinyEnd = static_cast<size_t>(PHI_TINY_PRIMES);
+        scanEnd = tinyEnd;
+        while (scanEnd < primes.size() && static_cast<uint64_t>(primes[scanEnd]) * primes[scanEnd] <= u) ++scanEnd;
+
+        uint64_t period = 1, totient = 1;
+        for (size_t b = 0; b <= tinyEnd; ++b) {
+            tinyPeriods.push_back(period);
+            tinyTotients.push_back(totient);
+            std::vector<uint16_t> counts(period, 0);
+            for (uint64_t r = 1; r < period; ++r) {
+                bool coprime = true;
+                for (size_t k = 0; k < b; ++k) coprime = coprime && (r % primes[k] != 0);
+                counts[r] = static_cast<uint16_t>(counts[r - 1] + coprime);
+            }
+            tinyCounts.push_back(std::move(counts));
+            if (b < tinyEnd) {
+                period *= primes[b];
+                totient *= primes[b] - 1;
+            }
+        }
+        // the 64 numbers from each residue of the last period, a bit set for those coprime to it,
+        // which is what a segment word starts from
+        std::vector<uint8_t> coprime(PHI_TINY_PERIOD, 0);
+        for (uint64_t r = 1; r < PHI_TINY_PERIOD; ++r) coprime[r] = tinyCounts[tinyEnd][r] != tinyCounts[tinyEnd][r - 1];
+        wheel.assign(PHI_TINY_PERIOD, 0);
+        for (uint64_t r = 0; r < PHI_TINY_PERIOD; ++r) {
+            for (uint64_t bit = 0; bit < 64; ++bit) {
+                wheel[r] |= static_cast<uint64_t>(coprime[(r + bit) % PHI_TINY_PERIOD]) << bit;
+            }
+        }
+    }
+
+    int64_t mu(uint64_t m) const { return (lpfMu[m] > 0) - (lpfMu[m] < 0); }
+
+    uint64_t leastFactor(uint64_t m) const {
+        return static_cast<uint64_t>(lpfMu[m] < 0 ? -static_cast<int64_t>(lpfMu[m]) : lpfMu[m]);
+    }
+
+    // phi(v, b) for b up to PHI_TINY_PRIMES, from its period
+    uint64_t tinyPhi(uint64_t v, size_t b) const {
+        uint64_t period = tinyPeriods[b];
+        return v / period * tinyTotients[b] + tinyCounts[b][v % period];
+    }
+
+    // How many primes have leaves in a segment from low: those up to sqrt(y / low)
+    size_t leafPrimesFrom(uint64_t low) const {
+        uint64_t bound = integerSqrt(y / low);
+        return primesUpTo(bound);
+    }
+
+    // pi(n), n capped at u
+    uint64_t primesUpTo(uint64_t n) const {
+        n = std::min(n, u);
+        const PiWord& word = piTable[n / 64];
+        return word.before + static_cast<uint64_t>(__builtin_popcountll(word.primes & (~0ULL >> (63 - n % 64))));
+    }
+
+    // Leaves of p = p_{b+1} with a prime m = q whose argument v = y / (p q) is below u. v is also
+    // below p^2, so phi(v, b) counts 1 and the primes from p to v. As mu(q) = -1, each leaf adds
+    // phi(v, b). While v is below sqrt(y / p), consecutive q mostly share pi(v) and are added a
+    // run at once; above it, one at a time.
+    __int128 easyLeaves(size_t b) const {
+        uint64_t p = primes[b], quotient = y / p;
+        uint64_t numPrimes = primes.size();
+
+        // the q above y / p^2 leave v below p, where only 1 is left
+        uint64_t next = std::max<uint64_t>(b + 1, primesUpTo(quotient / p));
+        __int128 sum = numPrimes - next;
+
+        // primes[next - 1] is the largest q not counted yet
+        uint64_t runEnd = std::max<uint64_t>(b + 1, primesUpTo(integerSqrt(quotient)));
+        while (next > runEnd) {
+            uint64_t v = divideByPrime(quotient, primes[next - 1], inverses[next - 1], exactDouble);
+            if (v >= u) return sum;
+            uint64_t below = primesUpTo(v);
+            // the smaller q share pi(v) until v reaches the next prime
+            uint64_t shared = (below < numPrimes)
+                ? primesUpTo(divideByPrime(quotient, primes[below], inverses[below], exactDouble))
+                : primesUpTo(quotient / u);
+            shared = std::max<uint64_t>(b + 1, shared);
+            sum += static_cast<__int128>(next - shared) * (below - b + 1);
+            next = shared;
+        }
+        uint64_t single = 0;
+        for (; next > b + 1; --next) {
+            uint64_t v = divideByPrime(quotient, primes[next - 1], inverses[next - 1], exactDouble);
+            if (v >= u) break;
+            single += primesUpTo(v) - b + 1;
+        }
+        return sum + single;
+    }
+
+    // Counts what is left of a segment up to ascending positions, summing each counter once
+    class SegmentCursor {
+    public:
+        explicit SegmentCursor(const SieveWorkspace& work) : work(work) {}
+
+        // Numbers left at positions up to i, which is at least the previous i
+        uint64_t countUpTo(uint64_t i) {
+            for (; counter < (i >> COUNTER_SHIFT); ++counter) counted += work.counters[counter];
+            uint64_t count = counted;
+            for (uint64_t w = counter << (COUNTER_SHIFT - 6); w < (i >> 6); ++w) {
+                count += static_cast<uint64_t>(__builtin_popcountll(work.segment[w]));
+            }
+            return count + static_cast<uint64_t>(__builtin_popcountll(work.segment[i >> 6] & (~0ULL >> (63 - (i & 63)))));
+        }
+
+    private:
+        const SieveWorkspace& work;
+        uint64_t counter = 0;
+        uint64_t counted = 0;
+    };
+
+    // Sieve segments [first, last) of [1, y / u], answering the leaves that fall in them and the
+    // part of P2 whose y / p does
+    void sieveBlock(uint64_t first, uint64_t last, SieveWorkspace& work, BlockCounts& block) const {
+        uint64_t blockLow = 1 + first * segmentSize;
+        size_t blockLeafPrimes = std::max(leafPrimesFrom(blockLow), tinyEnd);
+        block.left.assign(blockLeafPrimes, 0);
+        block.muSums.assign(blockLeafPrimes, 0);
+
+        work.segment.resize(segmentSize / 64);
+        work.counters.resize(segmentSize >> COUNTER_SHIFT);
+        work.nextMultiple.resize(primes.size());
+        for (size_t k = tinyEnd; k < primes.size(); ++k) {
+            uint64_t p = primes[k];
+            work.nextMultiple[k] = (blockLow + p - 1) / p * p;
+        }
+        // the hard leaves of a later prime p have v >= u, so q <= y / (p * max(low, u))
+        work.nextLeaf.resize(primes.size());
+        for (size_t b = scanEnd; b < blockLeafPrimes; ++b) {
+            uint64_t top = std::min(u, y / primes[b] / std::max(blockLow, u));
+            work.nextLeaf[b] = static_cast<uint32_t>(std::upper_bound(primes.begin(), primes.end(), top) - primes.begin());
+        }
+
+        std::vector<uint64_t>& segment = work.segment;
+        for (uint64_t s = first; s < last; ++s) {
+            uint64_t low = 1 + s * segmentSize;
+            uint64_t high = std::min(sieveEnd, low + segmentSize - 1);
+            uint64_t length = high - low + 1;
+            uint64_t numWords = (length + 63) / 64;
+
+            // start from the numbers coprime to the first primes
+            uint64_t left = 0;
+            for (uint64_t w = 0, r = low % PHI_TINY_PERIOD; w < numWords; ++w) {
+                segment[w] = wheel[r];
+                r = (r + 64) % PHI_TINY_PERIOD;
+            }
+            if (length % 64 != 0) segment[numWords - 1] &= ~0ULL >> (64 - length % 64);
+            std::vector<uint32_t>& counters = work.counters;
+            std::fill(counters.begin(), counters.end(), 0);
+            for (uint64_t w = 0; w < numWords; ++w) {
+                counters[w >> (COUNTER_SHIFT - 6)] += static_cast<uint32_t>(__builtin_popcountll(segment[w]));
+            }
+            for (uint32_t counter : counters) left += counter;
+
+            size_t leafPrimes = std::min(leafPrimesFrom(low), blockLeafPrimes);
+
+            for (size_t b = tinyEnd; b < primes.size(); ++b) {
+                if (b < leafPrimes) hardLeaves(b, low, high, work, block);
+                if (b < blockLeafPrimes) block.left[b] += left;
+
+                // cross off p_{b+1}, keeping the counts while later leaves and the block's counts
+                // still need them, and after that just clearing bits. Without a branch on whether
+                // the bit was set, which is close to random for the small primes.
+                uint64_t p = primes[b];
+                uint64_t multiple = work.nextMultiple[b];
+                if (b + 1 < leafPrimes) {
+                    for (; multiple <= high; multiple += p) {
+                        uint64_t i = multiple - low;
+                        uint64_t bit = (segment[i >> 6] >> (i & 63)) & 1;
+                        segment[i >> 6] &= ~(1ULL << (i & 63));
+                        counters[i >> COUNTER_SHIFT] -= static_cast<uint32_t>(bit);
+                        left -= bit;
+                    }
+                } else if (b + 1 < blockLeafPrimes) {
+                    for (; multiple <= high; multiple += p) {
+                        uint64_t i = multiple - low;
+                        left -= (segment[i >> 6] >> (i & 63)) & 1;
+                        segment[i >> 6] &= ~(1ULL << (i & 63));
+                    }
+                } else {
+                    for (; multiple <= high; multiple += p) {
+                        uint64_t i = multiple - low;
+                        segment[i >> 6] &= ~(1ULL << (i & 63));
+                    }
+                }
+                work.nextMultiple[b] = multiple;
+            }
+
+            secondPrimes(low, high, work, block);
+            for (uint64_t w = 0; w < numWords; ++w) {
+                block.primesLeft += static_cast<uint64_t>(__builtin_popcountll(segment[w]));
+            }
+        }
+    }
+
+    // Leaves of p = p_{b+1} whose argument falls in [low, high], counted with the first b primes crossed off
+    void hardLeaves(size_t b, uint64_t low, uint64_t high, SieveWorkspace& work, BlockCounts& block) const {
+        uint64_t p = primes[b], quotient = y / p;
+        uint64_t before = block.left[b];
+        SegmentCursor cursor(work);
+
+        if (b < scanEnd) {
+            // every squarefree m in (u / p, u] with no prime factor up to p, v = y / (p m) in [low, high]
+            uint64_t mLow = std::max(u / p, quotient / (high + 1));
+            uint64_t mHigh = std::min(u, quotient / low);
+            for (uint64_t m = mHigh; m > mLow; --m) {
+                if (leastFactor(m) <= p) continue;
+                uint64_t v = quotient / m;
+                int64_t sign = mu(m);
+                block.leafSum -= sign * static_cast<__int128>(before + cursor.countUpTo(v - low));
+                block.muSums[b] += sign;
+            }
+            return;
+        }
+
+        // primes q above p, taken in descending order so v ascends through the segments
+        uint32_t next = work.nextLeaf[b];
+        for (; next > b + 1; --next) {
+            uint64_t v = divideByPrime(quotient, primes[next - 1], inverses[next - 1], exactDouble);
+            if (v > high) break;
+            block.leafSum += before + cursor.countUpTo(v - low);
+            block.muSums[b] -= 1;
+        }
+        work.nextLeaf[b] = next;
+    }
+
+    // The primes p in (u, sqrt(y)] with y / p in [low, high], whose pi(y / p) P2 adds up. The
+    // segment holds only primes above u by now.
+    void secondPrimes(uint64_t low, uint64_t high, SieveWorkspace& work, BlockCounts& block) const {
+        uint64_t pHigh = std::min(root, y / low);
+        uint64_t pLow = std::max(u, y / (high + 1));
+        if (pHigh <= pLow) return;
+
+        // sieve (pLow, pHigh] with the primes up to its square root, which are all below u
+        std::vector<uint8_t>& candidates = work.candidates;
+        uint64_t width = pHigh - pLow;
+        candidates.assign(width, 1);
+        for (uint64_t q : primes) {
+            if (q * q > pHigh) break;
+            uint64_t multiple = std::max(q * q, (pLow + q) / q * q);
+            for (; multiple <= pHigh; multiple += q) candidates[multiple - pLow - 1] = 0;
+        }
+
+        // descending p ascends through the segment, whole words are counted once
+        const std::vector<uint64_t>& segment = work.segment;
+        uint64_t counted = 0, word = 0;
+        for (uint64_t i = width; i > 0; --i) {
+            if (!candidates[i - 1]) continue;
+            uint64_t position = y / (pLow + i) - low;
+            for (; word < position >> 6; ++word) counted += static_cast<uint64_t>(__builtin_popcountll(segment[word]));
+            uint64_t mask = ~0ULL >> (63 - (position & 63));
+            block.p2Sum += block.primesLeft + counted + static_cast<uint64_t>(__builtin_popcountll(segment[word] & mask));
+            ++block.p2Primes;
+        }
+    }
+
+    uint64_t y;
+    uint64_t u;
+    uint64_t sieveEnd;
+    uint64_t root;
+    bool exactDouble;
+    uint64_t segmentSize;
+
+    std::vector<uint32_t> primes; // up to u
+    std::vector<double> inverses; // of the primes
+    std::vector<PiWord> piTable;
+    std::vector<int32_t> lpfMu;
+    size_t tinyEnd = 0; // primes with leaves from phi's period
+    size_t scanEnd = 0; // primes up to sqrt(u)
+
+    std::vector<uint64_t> tinyPeriods;
+    std::vector<uint64_t> tinyTotients;
+    std::vector<std::vector<uint16_t>> tinyCounts;
+    std::vector<uint64_t> wheel;
+};
+
+// pi(n), the number of primes up to n
+inline uint64_t countPrimesUpTo(uint64_t n, int numThreads) {
+    return PrimeCounter(n).count(numThreads);
+}
@@ -0,0 +1,206 @@
+/**
+ * Library API: a lazy range over the primes of [a, b], for programs that want the primes
+ * themselves instead of the printed output.
+ *
+ *     for (uint64_t p : primes(a, b)) { ... }
+ *
+ * Nothing is sieved until the range is iterated. Then background threads sieve the segments
+ * ahead of the consumer, each into its own slot, and the consumer takes them in order. At most
+ * readAhead segments are sieved and not yet read, so a consumer that stops early, or simply
+ * reads slower than the threads sieve, leaves them waiting rather than running to b. Destroying
+ * the range stops the threads after the segment each is on.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "sieve.h"
+#include "topology.h"
+
+struct PrimeRangeOptions {
+    // Background sieving threads, 0 for one less than the cores (at least one)
+    int threads = 0;
+    // Segments sieved ahead of the consumer, 0 for two per thread
+    size_t readAhead = 0;
+    // Numbers per segment, 0 to size it from the L1 data cache
+    uint64_t segmentSize = 0;
+};
+
+// Sieves the segments of [first, last] on background threads, handing them out in order
+class SegmentPrefetcher {
+public:
+    SegmentPrefetcher(uint64_t first, uint64_t last, const PrimeRangeOptions& options)
+        : sieve(last), first(first), last(last) {
+        Config sizing;
+        sizing.segmentSize = options.segmentSize;
+        segmentSize = segmentSizeFor(sizing);
+        numSegments = (first > last) ? 0 : (last - first) / segmentSize + 1;
+
+        int numThreads = options.threads;
+        if (numThreads <= 0) numThreads = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1);
+        // no point in more threads than segments
+        numThreads = static_cast<int>(std::min<uint64_t>(numThreads, std::max<uint64_t>(numSegments, 1)));
+        size_t readAhead = (options.readAhead > 0) ? options.readAhead : 2 * static_cast<size_t>(numThreads);
+        slots.resize(std::max(readAhead, static_cast<size_t>(numThreads)));
+
+        for (int i = 0; i < numThreads; ++i) {
+            threads.emplace_back(&SegmentPrefetcher::sieveLoop, this);
+        }
+    }
+
+    ~SegmentPrefetcher() {
+        {
+            std::lock_guard<std::mutex> lock(slotsMutex);
+            stopping = true;
+        }
+        slotFreed.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    SegmentPrefetcher(const SegmentPrefetcher&) = delete;
+    SegmentPrefetcher& operator=(const SegmentPrefetcher&) = delete;
+
+    // Swap the primes of the next segment into primes, false once every segment has been read
+    bool next(std::vector<uint64_t>& primes) {
+        std::unique_lock<std::mutex> lock(slotsMutex);
+        if (nextToRead == numSegments) return false;
+
+        Slot& slot = slots[nextToRead % slots.size()];
+        slotFilled.wait(lock, [&] { return slot.filled; });
+        primes.swap(slot.primes);
+        slot.filled = false;
+        ++nextToRead;
+        lock.unlock();
+
+        slotFreed.notify_all();
+        return true;
+    }
+
+private:
+    struct Slot {
+        bool filled = false;
+        std::vector<uint64_t> primes;
+    };
+
+    void sieveLoop() {
+        std::vector<char> segment(segmentSize);
+        std::vector<uint64_t> primes;
+
+        while (true) {
+            uint64_t index;
+            {
+                std::unique_lock<std::mutex> lock(slotsMutex);
+                // claim the next segment once its slot is within the read-ahead window
+                slotFreed.wait(lock, [&] {
+                    return stopping || nextToClaim == numSegments || nextToClaim < nextToRead + slots.size();
+                });
+                if (stopping || nextToClaim == numSegments) return;
+                index = nextToClaim++;
+            }
+
+            uint64_t low = first + index * segmentSize;
+            uint64_t high = (last - low < segmentSize) ? last : low + segmentSize - 1;
+            sieve.sieveSegment(low, high, segment);
+            primes.clear();
+            for (uint64_t k = 0; k <= high - low; ++k) {
+                if (segment[k] && sieve.isSurvivorPrime(low + k)) primes.push_back(low + k);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(slotsMutex);
+                Slot& slot = slots[index % slots.size()];
+                slot.primes.swap(primes);
+                slot.filled = true;
+            }
+            slotFilled.notify_all();
+        }
+    }
+
+    const SegmentSieve sieve;
+    uint64_t first;
+    uint64_t last;
+    uint64_t segmentSize;
+    uint64_t numSegments;
+
+    // segment i goes into slots[i % slots.size()], so the slots bound the read-ahead
+    std::vector<Slot> slots;
+    uint64_t nextToClaim = 0;
+    uint64_t nextToRead = 0;
+    bool stopping = false;
+    std::mutex slotsMutex;
+    std::condition_variable slotFilled;
+    std::condition_variable slotFreed;
+    std::vector<std::thread> threads;
+};
+
+class PrimeRange {
+public:
+    PrimeRange(uint64_t a, uint64_t b, PrimeRangeOptions options = {}) : first(a), last(b), options(options) {}
+
+    class iterator {
+    public:
+        using value_type = uint64_t;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+
+        uint64_t operator*() const { return primes[position]; }
+
+        iterator& operator++() {
+            if (++position == primes.size()) fill();
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return prefetcher == nullptr; }
+
+    private:
+        friend class PrimeRange;
+
+        explicit iterator(SegmentPrefetcher* prefetcher) : prefetcher(prefetcher) { fill(); }
+
+        // Move on to the next segment holding a prime, or to the end
+        void fill() {
+            position = 0;
+            do {
+                if (!prefetcher->next(primes)) {
+                    prefetcher = nullptr;
+                    return;
+                }
+            } while (primes.empty());
+        }
+
+        SegmentPrefetcher* prefetcher = nullptr;
+        std::vector<uint64_t> primes;
+        size_t position = 0;
+    };
+
+    // Starts the background sieving, so a range is only iterated once
+    iterator begin() {
+        if (prefetcher == nullptr) prefetcher = std::make_unique<SegmentPrefetcher>(first, last, options);
+        return iterator(prefetcher.get());
+    }
+
+    std::default_sentinel_t end() const { return std::default_sentinel; }
+
+private:
+    uint64_t first;
+    uint64_t last;
+    PrimeRangeOptions options;
+    std::unique_ptr<SegmentPrefetcher> prefetcher;
+};
+
+// The primes of [a, b], sieved lazily as they are read
+inline PrimeRange primes(uint64_t a, uint64_t b, PrimeRangeOptions options = {}) {
+    return PrimeRange(a, b, options);
+}
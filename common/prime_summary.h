@@ -0,0 +1,82 @@
+/**
+ * Aggregates of the primes of a range: count, sum, largest gap and twin pairs. Summaries of
+ * neighbouring ranges merge in order, which is how format=reduce, the coordinator and the
+ * checkpoints combine the ranges searched separately.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+inline std::string toDecimal(unsigned __int128 value) {
+    std::string digits;
+    do {
+        digits.push_back(static_cast<char>('0' + static_cast<int>(value % 10)));
+        value /= 10;
+    } while (value != 0);
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+// Aggregates of the primes of a contiguous range, folded in ascending order
+struct PrimeSummary {
+    uint64_t count = 0;
+    unsigned __int128 sum = 0;
+    uint64_t first = 0;
+    uint64_t last = 0;
+    uint64_t largestGap = 0;
+    uint64_t gapStart = 0;
+    uint64_t twinPairs = 0;
+
+    void add(uint64_t prime) {
+        if (count > 0) addGap(last, prime);
+        else first = prime;
+        last = prime;
+        ++count;
+        sum += prime;
+    }
+
+    // Append the summary of a range that follows this one
+    void append(const PrimeSummary& next) {
+        if (next.count == 0) return;
+        if (count == 0) {
+            *this = next;
+            return;
+        }
+
+        addGap(last, next.first);
+        if (next.largestGap > largestGap) {
+            largestGap = next.largestGap;
+            gapStart = next.gapStart;
+        }
+        twinPairs += next.twinPairs;
+        count += next.count;
+        sum += next.sum;
+        last = next.last;
+    }
+
+private:
+    void addGap(uint64_t previous, uint64_t prime) {
+        uint64_t gap = prime - previous;
+        if (gap > largestGap) {
+            largestGap = gap;
+            gapStart = previous;
+        }
+        if (gap == 2) ++twinPairs;
+    }
+};
+
+inline void printSummary(const PrimeSummary& total) {
+    std::cout << "Primes found: " << total.count << std::endl;
+    std::cout << "Sum of primes: " << toDecimal(total.sum) << std::endl;
+    if (total.count > 1) {
+        std::cout << "Largest gap: " << total.largestGap << " (from " << total.gapStart << " to "
+                  << total.gapStart + total.largestGap << ")" << std::endl;
+    } else {
+        std::cout << "Largest gap: none" << std::endl;
+    }
+    std::cout << "Twin prime pairs: " << total.twinPairs << std::endl;
+}
@@ -0,0 +1,320 @@
+/**
+ * Print policies, picked at compile time by the engine:
+ * A1. ImmediatePrint writes each prime as soon as it is found.
+ * A2. DeferredPrint keeps the primes in a compact result store until all threads are done, then
+ *     prints them in order.
+ * A3. OrderedPrint streams the primes in order, holding back only the chunks finished ahead of
+ *     the lowest one still being searched.
+ *
+ * A policy is told about every prime with primeFound(threadId, prime, foundTime) and every
+ * dynamically claimed chunk with chunkClaimed(threadId, start, end), from the worker threads.
+ * Straight division also calls rangeSearched(threadId, start, end) once a thread has reported
+ * every prime of a slice or chunk.
+ * finish() is called once after all workers have stopped and adds what the policy measured to
+ * the run's metrics. It returns false if some of the output could not be written, having printed
+ * an error, and the run then exits with status 1.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async_writer.h"
+#include "checkpoint.h"
+#include "config.h"
+#include "metrics.h"
+#include "result_store.h"
+#include "timing.h"
+#include "trace.h"
+
+// Longest line any policy formats: thread id, timestamp and a 20 digit prime
+const int MAX_LINE_LENGTH = 96;
+
+inline int formatPrimeLine(char (&line)[MAX_LINE_LENGTH], int threadId, const char* timeBuffer,
+                           long long millis, uint64_t prime) {
+    return std::snprintf(line, sizeof(line), "Thread ID: %d | Timestamp: %s:%03lld | Prime: %llu\n",
+                         threadId, timeBuffer, millis, static_cast<unsigned long long>(prime));
+}
+
+inline int formatChunkLine(char (&line)[MAX_LINE_LENGTH], int threadId, uint64_t start, uint64_t end) {
+    return std::snprintf(line, sizeof(line), "Thread ID: %d | Chunk: %llu-%llu\n", threadId,
+                         static_cast<unsigned long long>(start), static_cast<unsigned long long>(end));
+}
+
+// finish() result of the policies printing to stdout, with an error if some of it was lost
+inline bool reportStdoutWritten(bool written) {
+    if (!written) std::cerr << "Error: Could not write the primes to stdout!" << std::endl;
+    return written;
+}
+
+class ImmediatePrint {
+public:
+    static constexpr const char* NAME = "immediate";
+
+    explicit ImmediatePrint(const Config& config)
+        : writer(std::make_unique<AsyncWriter>(config.xNumThreads, std::chrono::milliseconds(config.flushMillis))),
+          formatters(config.xNumThreads) {}
+
+    void reserve(int, size_t) {}
+
+    void primeFound(int threadId, uint64_t prime, TimePoint foundTime) {
+        long long millis;
+        const char* timeBuffer = formatters[threadId].format(foundTime, millis);
+
+        char line[MAX_LINE_LENGTH];
+        int length = formatPrimeLine(line, threadId, timeBuffer, millis, prime);
+        writer->write(threadId, line, length);
+    }
+
+    void chunkClaimed(int threadId, uint64_t start, uint64_t end) {
+        char line[MAX_LINE_LENGTH];
+        int length = formatChunkLine(line, threadId, start, end);
+        writer->write(threadId, line, length);
+    }
+
+    void rangeSearched(int, uint64_t, uint64_t) {}
+
+    // flush whatever the workers left in their rings before the summary is printed
+    bool finish(RunMetrics& metrics) {
+        for (size_t i = 0; i < metrics.threads.size(); ++i) {
+            metrics.threads[i].outputWaitNanos += writer->producerWaitNanos(static_cast<int>(i));
+        }
+        bool written = writer->stop();
+        writer.reset();
+        return reportStdoutWritten(written);
+    }
+
+private:
+    std::unique_ptr<AsyncWriter> writer;
+    std::vector<TimestampFormatter> formatters;
+};
+
+class DeferredPrint {
+public:
+    static constexpr const char* NAME = "deferred";
+
+    struct ChunkRecord {
+        int threadId;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    explicit DeferredPrint(const Config& config)
+        : threadColumns(config.xNumThreads), threadChunks(config.xNumThreads) {}
+
+    // Size a thread's gap column up front, about a byte per prime, so it is rarely reallocated
+    void reserve(int threadId, size_t count) {
+        auto& deltas = threadColumns[threadId].primeDeltas;
+        size_t needed = deltas.size() + count;
+        if (needed > deltas.capacity()) {
+            // grow geometrically so reserving per chunk stays amortized
+            deltas.reserve(std::max(needed, 2 * deltas.capacity()));
+        }
+    }
+
+    // Each thread only appends to its own columns, so nothing is locked when a prime is found
+    void primeFound(int threadId, uint64_t prime, TimePoint foundTime) {
+        threadColumns[threadId].append(prime, toTicks(foundTime));
+    }
+
+    void chunkClaimed(int threadId, uint64_t start, uint64_t end) {
+        threadChunks[threadId].push_back({threadId, start, end});
+    }
+
+    void rangeSearched(int, uint64_t, uint64_t) {}
+
+    bool finish(RunMetrics&) {
+        blocks = mergeColumns(threadColumns);
+
+        for (const auto& chunks : threadChunks) {
+            chunkResults.insert(chunkResults.end(), chunks.begin(), chunks.end());
+        }
+        std::sort(chunkResults.begin(), chunkResults.end(),
+                  [](const ChunkRecord& a, const ChunkRecord& b) { return a.start < b.start; });
+
+        printNumbers();
+        return reportStdoutWritten(static_cast<bool>(std::cout));
+    }
+
+private:
+    // The blocks are formatted by one thread each, a round of them at a time, and each round is
+    // written out in order once it is formatted
+    void printNumbers() {
+        int numFormatters = static_cast<int>(std::max<size_t>(threadChunks.size(), 1));
+        size_t roundSize = 2 * static_cast<size_t>(numFormatters);
+        std::vector<std::string> texts(roundSize);
+
+        for (size_t base = 0; base < blocks.size(); base += roundSize) {
+            size_t end = std::min(base + roundSize, blocks.size());
+
+            std::vector<std::thread> formatters;
+            for (int id = 0; id < numFormatters && base + id < end; ++id) {
+                formatters.emplace_back([this, &texts, base, end, id, numFormatters] {
+                    TimestampFormatter formatter;
+                    for (size_t k = base + id; k < end; k += numFormatters) {
+                        formatBlock(blocks[k], formatter, texts[k - base]);
+                    }
+                });
+            }
+            for (auto& t : formatters) t.join();
+
+            for (size_t k = base; k < end; ++k) {
+                std::cout.write(texts[k - base].data(), texts[k - base].size());
+            }
+        }
+
+        std::string output;
+        char line[MAX_LINE_LENGTH];
+        for (const auto& chunk : chunkResults) {
+            output.append(line, formatChunkLine(line, chunk.threadId, chunk.start, chunk.end));
+        }
+
+        std::cout.write(output.data(), output.size());
+        std::cout.flush();
+    }
+
+    static void formatBlock(const ResultBlock& block, TimestampFormatter& formatter, std::string& text) {
+        text.clear();
+        text.reserve(block.count * 64);
+
+        char line[MAX_LINE_LENGTH];
+        block.forEach([&](uint64_t prime, int threadId, int64_t ticks) {
+            long long millis;
+            const char* timeBuffer = formatter.format(fromTicks(ticks), millis);
+            text.append(line, formatPrimeLine(line, threadId, timeBuffer, millis, prime));
+        });
+    }
+
+    std::vector<ThreadColumns> threadColumns;
+    std::vector<std::vector<ChunkRecord>> threadChunks;
+    std::vector<ResultBlock> blocks;
+    std::vector<ChunkRecord> chunkResults;
+};
+
+class OrderedPrint {
+public:
+    static constexpr const char* NAME = "ordered";
+
+    explicit OrderedPrint(const Config& config)
+        : threadChunks(config.xNumThreads), firstStart(config.startNumber), nextStart(config.startNumber),
+          window(config.reorderWindow), checkpoints(config, NAME), trace(config.trace) {
+        // a resumed run carries on after what was written, prepareCheckpoint() has cut the output back to it
+        if (config.resumeFrom != nullptr && !config.resumeFrom->ranges.empty()) {
+            nextStart = config.resumeFrom->ranges.front().end + 1;
+        }
+    }
+
+    void reserve(int, size_t) {}
+
+    // Lines of a chunk collect in the thread's own buffer. Outside any chunk, as from linear
+    // division's ordered commit stage, primes already arrive in order and are written through.
+    void primeFound(int threadId, uint64_t prime, TimePoint foundTime) {
+        ThreadChunk& chunk = threadChunks[threadId];
+        long long millis;
+        const char* timeBuffer = chunk.formatter.format(foundTime, millis);
+
+        char line[MAX_LINE_LENGTH];
+        int length = formatPrimeLine(line, threadId, timeBuffer, millis, prime);
+        if (chunk.active) {
+            chunk.text.append(line, length);
+        } else {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            std::cout.write(line, length);
+        }
+    }
+
+    void chunkClaimed(int threadId, uint64_t start, uint64_t end) {
+        ThreadChunk& chunk = threadChunks[threadId];
+        chunk.active = true;
+
+        char line[MAX_LINE_LENGTH];
+        chunk.text.assign(line, formatChunkLine(line, threadId, start, end));
+    }
+
+    // Hand a finished chunk to the reorder buffer, first waiting while the buffer holds a full
+    // window of chunks that are ahead of the lowest one still being searched
+    void rangeSearched(int threadId, uint64_t start, uint64_t end) {
+        ThreadChunk& chunk = threadChunks[threadId];
+        if (!chunk.active) return;
+        chunk.active = false;
+
+        std::unique_lock<std::mutex> lock(reorderMutex);
+        if (start != nextStart && pending.size() >= window) {
+            auto waitStart = std::chrono::steady_clock::now();
+            windowOpen.wait(lock, [&] { return start == nextStart || pending.size() < window; });
+            chunk.waitNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - waitStart).count();
+            if (trace != nullptr) trace->thread(threadId).span(TraceKind::OutputWait, traceTicks(waitStart), start);
+        }
+        pending.emplace(start, PendingChunk{end, std::move(chunk.text)});
+        chunk.text = std::string();
+
+        // write out every chunk that now follows on from what was written
+        std::vector<std::string> ready;
+        while (!pending.empty() && pending.begin()->first == nextStart) {
+            auto first = pending.begin();
+            nextStart = first->second.end + 1;
+            ready.push_back(std::move(first->second.text));
+            pending.erase(first);
+        }
+        if (ready.empty()) return;
+
+        // taking the write lock before releasing the reorder lock keeps the writes in order
+        uint64_t writtenEnd = nextStart - 1;
+        std::unique_lock<std::mutex> writeLock(writeMutex);
+        lock.unlock();
+        windowOpen.notify_all();
+        for (const auto& text : ready) std::cout.write(text.data(), text.size());
+
+        Checkpoint snapshot;
+        if (!checkpoints.due(snapshot)) return;
+        snapshot.outputOffset = syncOutput();
+        snapshot.ranges.push_back({firstStart, writtenEnd, PrimeSummary()});
+        writeLock.unlock();
+        checkpoints.save(snapshot);
+    }
+
+    bool finish(RunMetrics& metrics) {
+        for (size_t i = 0; i < metrics.threads.size(); ++i) {
+            metrics.threads[i].outputWaitNanos += threadChunks[i].waitNanos;
+        }
+        std::cout.flush();
+        return reportStdoutWritten(static_cast<bool>(std::cout));
+    }
+
+private:
+    struct alignas(64) ThreadChunk {
+        std::string text;
+        bool active = false;
+        long long waitNanos = 0;
+        TimestampFormatter formatter;
+    };
+
+    struct PendingChunk {
+        uint64_t end;
+        std::string text;
+    };
+
+    std::vector<ThreadChunk> threadChunks;
+    // chunks finished ahead of nextStart, the start of the lowest chunk not written yet
+    std::map<uint64_t, PendingChunk> pending;
+    uint64_t firstStart;
+    uint64_t nextStart;
+    size_t window;
+    std::mutex reorderMutex;
+    std::condition_variable windowOpen;
+    std::mutex writeMutex;
+    CheckpointWriter checkpoints;
+    std::shared_ptr<RunTrace> trace;
+};
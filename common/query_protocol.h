@@ -0,0 +1,116 @@
+/**
+ * Binary protocol of the prime query server, spoken over a Unix domain socket.
+ *
+ * A client sends fixed 24-byte requests and gets one response per request, in order, on the
+ * same connection. All fields are little-endian (the native order on every supported platform).
+ *
+ *   request:  u32 type, u32 reserved, u64 a, u64 b
+ *   response: u32 status, u32 reserved, u64 count, then count u64 primes for QUERY_PRIMES
+ *
+ * count is the number of primes in [a, b] for QUERY_PRIMES and QUERY_COUNT, and 1 or 0 for
+ * QUERY_IS_PRIME, which only looks at a.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+const uint32_t QUERY_PRIMES = 1;
+const uint32_t QUERY_COUNT = 2;
+const uint32_t QUERY_IS_PRIME = 3;
+
+const uint32_t STATUS_OK = 0;
+const uint32_t STATUS_BAD_RANGE = 1;
+const uint32_t STATUS_UNKNOWN_QUERY = 2;
+
+// Widest [a, b] the server lists or counts, so one request cannot hold a worker for minutes
+const uint64_t MAX_LIST_RANGE = 1ULL << 28;
+const uint64_t MAX_COUNT_RANGE = 1ULL << 36;
+
+// How long the server waits for the rest of a request, or for a client to take its response,
+// before it closes the connection
+const int CLIENT_TIMEOUT_MS = 5000;
+
+struct QueryRequest {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t a;
+    uint64_t b;
+};
+static_assert(sizeof(QueryRequest) == 24, "requests are 24 bytes on the wire");
+
+struct QueryResponseHeader {
+    uint32_t status;
+    uint32_t reserved;
+    uint64_t count;
+};
+static_assert(sizeof(QueryResponseHeader) == 16, "response headers are 16 bytes on the wire");
+
+#ifndef _WIN32
+// Read exactly length bytes, false on error or if the peer closed the connection first
+inline bool readFully(int fd, void* data, size_t length) {
+    char* out = static_cast<char*>(data);
+    while (length > 0) {
+        ssize_t received = ::read(fd, out, length);
+        if (received <= 0) return false;
+        out += received;
+        length -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+inline bool writeFully(int fd, const void* data, size_t length) {
+    const char* in = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t sent = ::send(fd, in, length, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        in += sent;
+        length -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+// Bound how long a blocking read or write on fd may take
+inline void setSocketTimeout(int fd, int millis) {
+    timeval timeout;
+    timeout.tv_sec = millis / 1000;
+    timeout.tv_usec = (millis % 1000) * 1000;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+inline bool socketAddress(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) return false;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// Connected socket to the server at path, or -1
+inline int connectToServer(const std::string& path) {
+    sockaddr_un address;
+    if (!socketAddress(path, address)) return -1;
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
@@ -0,0 +1,345 @@
+/**
+ * Prime query server: answers "primes in [a, b]", "count in [a, b]" and "is n prime" over
+ * the protocol in query_protocol.h.
+ *
+ * One thread polls the listening socket and the open connections, and x worker threads answer
+ * the requests as they arrive, one request at a time. A client that stalls halfway through a
+ * request, or stops reading its response, is disconnected after CLIENT_TIMEOUT_MS instead of
+ * holding a worker.
+ * Sieved segments go into an LRU cache shared by all workers, so repeated and overlapping
+ * queries are answered from memory, and the base prime table is built once at startup. A query
+ * spanning more segments than the cache holds reads what is cached but does not add to it.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "config.h"
+#include "primality.h"
+#include "query_protocol.h"
+#include "sieve.h"
+
+// One sieved segment as a bitset, bit k set if low + k is prime
+struct SieveSegment {
+    uint64_t low;
+    std::vector<uint64_t> bits;
+};
+
+// Least recently used segments are dropped once the cache holds capacity segments
+class SegmentCache {
+public:
+    explicit SegmentCache(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    std::shared_ptr<const SieveSegment> find(uint64_t index) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = entries.find(index);
+        if (it == entries.end()) return nullptr;
+
+        // move to the front of the recency list
+        recency.splice(recency.begin(), recency, it->second.position);
+        return it->second.segment;
+    }
+
+    void insert(uint64_t index, std::shared_ptr<const SieveSegment> segment) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (entries.count(index) != 0) return;
+
+        recency.push_front(index);
+        entries[index] = {std::move(segment), recency.begin()};
+        if (entries.size() > capacity) {
+            entries.erase(recency.back());
+            recency.pop_back();
+        }
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const SieveSegment> segment;
+        std::list<uint64_t>::iterator position;
+    };
+
+    size_t capacity;
+    std::mutex cacheMutex;
+    std::list<uint64_t> recency;
+    std::unordered_map<uint64_t, Entry> entries;
+};
+
+class QueryServer {
+public:
+    explicit QueryServer(const Config& config)
+        : config(config), sieve(FULL_SIEVE_LIMIT * FULL_SIEVE_LIMIT), cache(config.segmentCacheSize) {}
+
+    // Serve until stop() is called, returns false if the socket could not be set up
+    bool run() {
+#ifdef _WIN32
+        std::cerr << "Error: the query server needs Unix domain sockets!" << std::endl;
+        return false;
+#else
+        sockaddr_un address;
+        if (!socketAddress(config.socketPath, address)) {
+            std::cerr << "Error: socket path is too long!" << std::endl;
+            return false;
+        }
+
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        ::unlink(config.socketPath.c_str());
+        if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listenFd, 128) != 0 || ::pipe(wakePipe) != 0) {
+            std::cerr << "Error: Could not listen on " << config.socketPath << "!" << std::endl;
+            return false;
+        }
+
+        std::cout << "Listening on " << config.socketPath << " with " << config.xNumThreads << " threads" << std::endl;
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < config.xNumThreads; ++i) {
+            workers.emplace_back(&QueryServer::workerLoop, this);
+        }
+        pollLoop();
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping.store(true);
+        }
+        queueCondition.notify_all();
+        for (auto& t : workers) t.join();
+
+        for (int fd : idleConnections) ::close(fd);
+        for (int fd : readyConnections) ::close(fd);
+        ::close(listenFd);
+        ::close(wakePipe[0]);
+        ::close(wakePipe[1]);
+        ::unlink(config.socketPath.c_str());
+        return true;
+#endif
+    }
+
+    // Wakes the poll loop so run() returns, safe to call from a signal handler
+    void stop() {
+#ifndef _WIN32
+        stopRequested.store(true);
+        char wake = 0;
+        [[maybe_unused]] ssize_t written = ::write(wakePipe[1], &wake, 1);
+#endif
+    }
+
+private:
+#ifndef _WIN32
+    // Watches the listening socket and every idle connection. A connection with a request waiting
+    // is handed to the workers one request at a time, so a busy client cannot hold a worker while
+    // others queue behind it.
+    void pollLoop() {
+        std::vector<pollfd> watched;
+        while (!stopRequested.load()) {
+            watched.assign({{listenFd, POLLIN, 0}, {wakePipe[0], POLLIN, 0}});
+            for (int fd : idleConnections) watched.push_back({fd, POLLIN, 0});
+
+            if (::poll(watched.data(), watched.size(), -1) < 0) continue;
+
+            if (watched[1].revents != 0) {
+                char drained[64];
+                [[maybe_unused]] ssize_t received = ::read(wakePipe[0], drained, sizeof(drained));
+            }
+
+            // connections handed back by the workers become idle again
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                idleConnections.insert(idleConnections.end(), returnedConnections.begin(), returnedConnections.end());
+                returnedConnections.clear();
+            }
+
+            std::vector<int> ready;
+            for (size_t i = 2; i < watched.size(); ++i) {
+                if (watched[i].revents != 0) ready.push_back(watched[i].fd);
+            }
+            if (!ready.empty()) {
+                idleConnections.erase(std::remove_if(idleConnections.begin(), idleConnections.end(), [&](int fd) {
+                    return std::find(ready.begin(), ready.end(), fd) != ready.end();
+                }), idleConnections.end());
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    readyConnections.insert(readyConnections.end(), ready.begin(), ready.end());
+                }
+                queueCondition.notify_all();
+            }
+
+            if (watched[0].revents != 0) {
+                int fd = ::accept(listenFd, nullptr, nullptr);
+                if (fd >= 0) {
+                    setSocketTimeout(fd, CLIENT_TIMEOUT_MS);
+                    idleConnections.push_back(fd);
+                }
+            }
+        }
+    }
+
+    void workerLoop() {
+        std::vector<uint64_t> primes;
+        while (true) {
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping.load() || !readyConnections.empty(); });
+                if (stopping.load()) return;
+                fd = readyConnections.front();
+                readyConnections.pop_front();
+            }
+
+            if (!serveRequest(fd, primes)) {
+                // the client hung up, broke the protocol or timed out
+                ::close(fd);
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                returnedConnections.push_back(fd);
+            }
+            char wake = 0;
+            [[maybe_unused]] ssize_t written = ::write(wakePipe[1], &wake, 1);
+        }
+    }
+
+    bool serveRequest(int fd, std::vector<uint64_t>& primes) {
+        QueryRequest request;
+        if (!readFully(fd, &request, sizeof(request))) return false;
+
+        QueryResponseHeader response = {STATUS_OK, 0, 0};
+        primes.clear();
+        answer(request, response, primes);
+
+        return writeFully(fd, &response, sizeof(response)) &&
+               writeFully(fd, primes.data(), primes.size() * sizeof(uint64_t));
+    }
+#endif
+
+    void answer(const QueryRequest& request, QueryResponseHeader& response, std::vector<uint64_t>& primes) {
+        if (request.type == QUERY_IS_PRIME) {
+            response.count = isPrimeCached(request.a) ? 1 : 0;
+            return;
+        }
+        if (request.type != QUERY_PRIMES && request.type != QUERY_COUNT) {
+            response.status = STATUS_UNKNOWN_QUERY;
+            return;
+        }
+
+        uint64_t limit = (request.type == QUERY_PRIMES) ? MAX_LIST_RANGE : MAX_COUNT_RANGE;
+        if (request.a > request.b || request.b - request.a >= limit) {
+            response.status = STATUS_BAD_RANGE;
+            return;
+        }
+
+        bool list = request.type == QUERY_PRIMES;
+        uint64_t firstIndex = request.a / SEGMENT_SIZE, lastIndex = request.b / SEGMENT_SIZE;
+        // a range wider than the cache would evict every hot segment on its way through, so it only
+        // reads the segments already cached and sieves the rest into a scratch segment
+        bool keep = lastIndex - firstIndex < config.segmentCacheSize;
+        thread_local SieveSegment scratch;
+        for (uint64_t index = firstIndex; index <= lastIndex; ++index) {
+            std::shared_ptr<const SieveSegment> cached = keep ? segmentAt(index) : cache.find(index);
+            if (cached == nullptr) sieveInto(index, scratch);
+            const SieveSegment& segment = (cached != nullptr) ? *cached : scratch;
+
+            uint64_t first = std::max(request.a, segment.low) - segment.low;
+            uint64_t last = std::min(request.b - segment.low, SEGMENT_SIZE - 1);
+            response.count += list ? collectPrimes(segment, first, last, primes) : countPrimes(segment, first, last);
+        }
+    }
+
+    // A cached segment answers for free, otherwise one number is cheaper to test than a segment to sieve
+    bool isPrimeCached(uint64_t n) {
+        std::shared_ptr<const SieveSegment> segment = cache.find(n / SEGMENT_SIZE);
+        if (segment == nullptr) return isPrime(n);
+
+        uint64_t k = n - segment->low;
+        return (segment->bits[k / 64] >> (k % 64)) & 1;
+    }
+
+    std::shared_ptr<const SieveSegment> segmentAt(uint64_t index) {
+        std::shared_ptr<const SieveSegment> segment = cache.find(index);
+        if (segment != nullptr) return segment;
+
+        // sieved outside the cache lock, if two workers race for it the second insert is dropped
+        auto sieved = std::make_shared<SieveSegment>();
+        sieveInto(index, *sieved);
+        cache.insert(index, sieved);
+        return sieved;
+    }
+
+    void sieveInto(uint64_t index, SieveSegment& segment) const {
+        segment.low = index * SEGMENT_SIZE;
+        uint64_t high = (UINT64_MAX - segment.low < SEGMENT_SIZE) ? UINT64_MAX : segment.low + SEGMENT_SIZE - 1;
+        segment.bits.assign(SEGMENT_SIZE / 64, 0);
+
+        thread_local std::vector<char> numbers(SEGMENT_SIZE);
+        sieve.sieveSegment(segment.low, high, numbers);
+        for (uint64_t k = 0; k <= high - segment.low; ++k) {
+            if (numbers[k] && sieve.isSurvivorPrime(segment.low + k)) {
+                segment.bits[k / 64] |= 1ULL << (k % 64);
+            }
+        }
+    }
+
+    // Bits first..last of the segment, whole words at a time
+    template <class WordAction>
+    static void forEachWord(const SieveSegment& segment, uint64_t first, uint64_t last, WordAction&& action) {
+        for (uint64_t word = first / 64; word <= last / 64; ++word) {
+            uint64_t bits = segment.bits[word];
+            if (word == first / 64) bits &= ~0ULL << (first % 64);
+            if (word == last / 64 && last % 64 != 63) bits &= (1ULL << (last % 64 + 1)) - 1;
+            action(word, bits);
+        }
+    }
+
+    static uint64_t countPrimes(const SieveSegment& segment, uint64_t first, uint64_t last) {
+        uint64_t count = 0;
+        forEachWord(segment, first, last, [&](uint64_t, uint64_t bits) { count += __builtin_popcountll(bits); });
+        return count;
+    }
+
+    static uint64_t collectPrimes(const SieveSegment& segment, uint64_t first, uint64_t last,
+                                  std::vector<uint64_t>& primes) {
+        size_t before = primes.size();
+        forEachWord(segment, first, last, [&](uint64_t word, uint64_t bits) {
+            while (bits != 0) {
+                primes.push_back(segment.low + word * 64 + __builtin_ctzll(bits));
+                bits &= bits - 1;
+            }
+        });
+        return primes.size() - before;
+    }
+
+    const Config& config;
+    const SegmentSieve sieve;
+    SegmentCache cache;
+    int listenFd = -1;
+    int wakePipe[2] = {-1, -1};
+    std::atomic<bool> stopRequested{false};
+
+    // Connections are idle (watched by the poll loop), ready (a request is waiting for a worker),
+    // or being served by a worker and then returned
+    std::vector<int> idleConnections;
+    std::deque<int> readyConnections;
+    std::vector<int> returnedConnections;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::atomic<bool> stopping{false};
+};
@@ -0,0 +1,121 @@
+/**
+ * Reduction output, used in place of the print policies when config.txt sets format=reduce:
+ * only the number of primes, their sum, the largest gap between consecutive primes and the
+ * number of twin prime pairs are reported, and no prime is kept.
+ *
+ * Each thread folds the primes of the range it is searching into a thread-local summary. When
+ * the division policy reports the range done with rangeSearched(), the summary is merged into
+ * the summaries of the neighbouring finished ranges, which also covers the gap and twin pair
+ * across the boundary. Only ranges with an unfinished one between them stay apart, so at most
+ * one summary per thread is pending and memory stays O(threads) whatever y is. The finished
+ * ranges are also what a checkpoint records, see checkpoint.h.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+#include "config.h"
+#include "metrics.h"
+#include "prime_summary.h"
+#include "timing.h"
+
+class ReductionOutput {
+public:
+    static constexpr const char* NAME = "reduce";
+
+    explicit ReductionOutput(const Config& config)
+        : threadSummaries(config.xNumThreads), checkpoints(config, NAME) {
+        if (config.resumeFrom != nullptr) {
+            for (const auto& range : config.resumeFrom->ranges) {
+                finishedRanges.emplace(range.start, FinishedRange{range.end, range.summary});
+            }
+        }
+    }
+
+    void reserve(int, size_t) {}
+
+    void primeFound(int threadId, uint64_t prime, TimePoint) {
+        threadSummaries[threadId].summary.add(prime);
+    }
+
+    void chunkClaimed(int, uint64_t, uint64_t) {}
+
+    // Merge the thread's summary of [start, end] with the finished ranges next to it
+    void rangeSearched(int threadId, uint64_t start, uint64_t end) {
+        PrimeSummary& summary = threadSummaries[threadId].summary;
+        std::unique_lock<std::mutex> lock(rangesMutex);
+        addRange(summary, start, end);
+        summary = PrimeSummary();
+
+        Checkpoint snapshot;
+        if (!checkpoints.due(snapshot)) return;
+        for (const auto& [rangeStart, range] : finishedRanges) {
+            snapshot.ranges.push_back({rangeStart, range.end, range.summary});
+        }
+        lock.unlock();
+        checkpoints.save(snapshot);
+    }
+
+    // The summary of every finished range, in order
+    PrimeSummary total() const {
+        PrimeSummary total;
+        for (const auto& [start, range] : finishedRanges) total.append(range.summary);
+        return total;
+    }
+
+    bool finish(RunMetrics&) {
+        printSummary(total());
+        return true;
+    }
+
+private:
+    struct alignas(64) ThreadSummary {
+        PrimeSummary summary;
+    };
+
+    struct FinishedRange {
+        uint64_t end;
+        PrimeSummary summary;
+    };
+
+    using RangeMap = std::map<uint64_t, FinishedRange>;
+
+    void addRange(const PrimeSummary& summary, uint64_t start, uint64_t end) {
+        auto next = finishedRanges.lower_bound(start);
+        if (next != finishedRanges.begin()) {
+            auto previous = std::prev(next);
+            if (previous->second.end + 1 == start) {
+                previous->second.summary.append(summary);
+                previous->second.end = end;
+                mergeWithNext(previous, next);
+                return;
+            }
+        }
+
+        auto inserted = finishedRanges.emplace_hint(next, start, FinishedRange{end, summary});
+        mergeWithNext(inserted, next);
+    }
+
+    void mergeWithNext(RangeMap::iterator range, RangeMap::iterator next) {
+        if (next == finishedRanges.end() || range->second.end == UINT64_MAX ||
+            range->second.end + 1 != next->first) {
+            return;
+        }
+        range->second.summary.append(next->second.summary);
+        range->second.end = next->second.end;
+        finishedRanges.erase(next);
+    }
+
+    std::vector<ThreadSummary> threadSummaries;
+    std::mutex rangesMutex;
+    RangeMap finishedRanges;
+    CheckpointWriter checkpoints;
+};
@@ -0,0 +1,243 @@
+/**
+ * Columnar store for the primes deferred printing keeps until the search is done.
+ *
+ * Instead of a record per prime, every field is its own compact column:
+ *   primes      the gap from the previous prime as a varint, about 1 byte each
+ *   thread ids  run-length encoded, so a thread's slice of the range costs a few bytes in all
+ *   timestamps  raw int64 ticks, run-length encoded and only formatted when printing
+ * Timestamps are printed to the millisecond, so ticks are milliseconds and every prime stamped in
+ * the same millisecond shares one entry. With straight division a prime costs about 1 byte and
+ * with linear division, where consecutive primes alternate between threads, about 3. Both are
+ * within the 4 bytes per prime the store is meant to stay under.
+ *
+ * Each thread appends to its own ThreadColumns while searching. mergeColumns() then merges the
+ * threads' ascending runs into ResultBlocks of BLOCK_PRIMES primes in ascending order, and each
+ * block can be decoded on its own, so the blocks are formatted in parallel.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+#include "timing.h"
+#include "varint.h"
+
+// Primes per block, the unit the printing threads format
+const uint64_t BLOCK_PRIMES = 1 << 16;
+
+inline int64_t toTicks(TimePoint time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+inline TimePoint fromTicks(int64_t ticks) {
+    return TimePoint(std::chrono::milliseconds(ticks));
+}
+
+// Values that repeat, stored as (zigzag delta from the previous value, repeat count) varint pairs
+class RunLengthColumn {
+public:
+    void append(int64_t value) {
+        if (pendingCount > 0 && value == pendingValue) {
+            ++pendingCount;
+            return;
+        }
+        flush();
+        pendingValue = value;
+        pendingCount = 1;
+    }
+
+    // Write out the value still being repeated, so a reader can start right after it
+    void flush() {
+        if (pendingCount == 0) return;
+        appendVarint(bytes, zigzagEncode(pendingValue - lastValue));
+        appendVarint(bytes, pendingCount);
+        lastValue = pendingValue;
+        pendingCount = 0;
+    }
+
+    size_t size() const { return bytes.size(); }
+
+    // The value the next entry is a delta from
+    int64_t base() const { return lastValue; }
+
+    class Reader {
+    public:
+        Reader(const RunLengthColumn& column, size_t offset, int64_t base)
+            : data(column.bytes.data() + offset), value(base) {}
+
+        int64_t next() {
+            if (remaining == 0) {
+                value += zigzagDecode(decodeVarint(data));
+                remaining = decodeVarint(data);
+            }
+            --remaining;
+            return value;
+        }
+
+    private:
+        const uint8_t* data;
+        int64_t value;
+        uint64_t remaining = 0;
+    };
+
+    void shrink() { bytes.shrink_to_fit(); }
+
+private:
+    std::vector<uint8_t> bytes;
+    int64_t lastValue = 0;
+    int64_t pendingValue = 0;
+    uint64_t pendingCount = 0;
+};
+
+// One thread's primes, as ascending runs. A prime below the previous one starts a new run.
+struct alignas(64) ThreadColumns {
+    struct Run {
+        uint64_t first;
+        uint64_t last;
+        uint64_t count;
+        size_t deltaOffset;
+        size_t timeOffset;
+        int64_t timeBase;
+    };
+
+    std::vector<uint8_t> primeDeltas;
+    RunLengthColumn times;
+    std::vector<Run> runs;
+
+    void append(uint64_t prime, int64_t ticks) {
+        if (runs.empty() || prime < runs.back().last) {
+            times.flush();
+            runs.push_back({prime, prime, 0, primeDeltas.size(), times.size(), times.base()});
+        } else {
+            appendVarint(primeDeltas, prime - runs.back().last);
+        }
+
+        Run& run = runs.back();
+        run.last = prime;
+        ++run.count;
+        times.append(ticks);
+    }
+};
+
+// BLOCK_PRIMES consecutive primes of the merged result, decodable on their own
+struct ResultBlock {
+    uint64_t first = 0;
+    uint64_t count = 0;
+    uint64_t last = 0;
+    std::vector<uint8_t> primeDeltas;
+    RunLengthColumn threadIds;
+    RunLengthColumn times;
+
+    void append(uint64_t prime, int threadId, int64_t ticks) {
+        if (count == 0) first = prime;
+        else appendVarint(primeDeltas, prime - last);
+        last = prime;
+        ++count;
+        threadIds.append(threadId);
+        times.append(ticks);
+    }
+
+    void seal() {
+        threadIds.flush();
+        times.flush();
+        primeDeltas.shrink_to_fit();
+        threadIds.shrink();
+        times.shrink();
+    }
+
+    size_t byteSize() const {
+        return primeDeltas.size() + threadIds.size() + times.size();
+    }
+
+    // Calls visit(prime, threadId, ticks) for each prime of the block in order
+    template <class Visit>
+    void forEach(Visit visit) const {
+        const uint8_t* delta = primeDeltas.data();
+        RunLengthColumn::Reader threadReader(threadIds, 0, 0), timeReader(times, 0, 0);
+
+        uint64_t prime = first;
+        for (uint64_t i = 0; i < count; ++i) {
+            if (i > 0) prime += decodeVarint(delta);
+            visit(prime, static_cast<int>(threadReader.next()), timeReader.next());
+        }
+    }
+};
+
+// Decodes one run of a thread's columns, positioned on its current prime
+struct RunCursor {
+    RunCursor(const ThreadColumns& columns, const ThreadColumns::Run& run, int threadId)
+        : delta(columns.primeDeltas.data() + run.deltaOffset), timeReader(columns.times, run.timeOffset, run.timeBase),
+          remaining(run.count), threadId(threadId), prime(run.first), ticks(timeReader.next()) {}
+
+    bool advance() {
+        if (--remaining == 0) return false;
+        prime += decodeVarint(delta);
+        ticks = timeReader.next();
+        return true;
+    }
+
+    const uint8_t* delta;
+    RunLengthColumn::Reader timeReader;
+    uint64_t remaining;
+    int threadId;
+    uint64_t prime;
+    int64_t ticks;
+};
+
+// Merge every thread's runs into blocks in ascending order. Runs are taken in order of their first
+// prime and a run is drained without the heap for as long as no other run has a smaller prime,
+// so disjoint runs, as from straight division, are simply concatenated.
+inline std::vector<ResultBlock> mergeColumns(std::vector<ThreadColumns>& threads) {
+    std::vector<RunCursor> cursors;
+    for (size_t id = 0; id < threads.size(); ++id) {
+        threads[id].times.flush();
+        for (const auto& run : threads[id].runs) cursors.emplace_back(threads[id], run, static_cast<int>(id));
+    }
+    std::sort(cursors.begin(), cursors.end(),
+              [](const RunCursor& a, const RunCursor& b) { return a.prime < b.prime; });
+
+    std::vector<ResultBlock> blocks;
+    auto emit = [&](const RunCursor& cursor) {
+        if (blocks.empty() || blocks.back().count == BLOCK_PRIMES) {
+            if (!blocks.empty()) blocks.back().seal();
+            blocks.emplace_back();
+        }
+        blocks.back().append(cursor.prime, cursor.threadId, cursor.ticks);
+    };
+
+    auto later = [&](size_t a, size_t b) { return cursors[a].prime > cursors[b].prime; };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> active(later);
+    size_t nextRun = 0;
+
+    while (!active.empty() || nextRun < cursors.size()) {
+        size_t current;
+        if (active.empty() || (nextRun < cursors.size() && cursors[nextRun].prime < cursors[active.top()].prime)) {
+            current = nextRun++;
+        } else {
+            current = active.top();
+            active.pop();
+        }
+
+        // nothing else can come before this limit
+        uint64_t limit = UINT64_MAX;
+        if (!active.empty()) limit = cursors[active.top()].prime;
+        if (nextRun < cursors.size()) limit = std::min(limit, cursors[nextRun].prime);
+
+        RunCursor& cursor = cursors[current];
+        bool more = true;
+        do {
+            emit(cursor);
+            more = cursor.advance();
+        } while (more && cursor.prime < limit);
+        if (more) active.push(current);
+    }
+    if (!blocks.empty()) blocks.back().seal();
+
+    // the merged blocks now hold every prime
+    for (auto& columns : threads) columns = ThreadColumns();
+    return blocks;
+}
@@ -0,0 +1,79 @@
+/**
+ * Segmented Sieve of Eratosthenes over a shared table of base primes.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "primality.h"
+
+// Numbers sieved per segment, sized so the segment stays resident in L1/L2
+const uint64_t SEGMENT_SIZE = 32 * 1024;
+
+// Largest sqrt(y) for which every base prime is sieved with. Above it the segments are only
+// prefiltered with primes up to PREFILTER_LIMIT and the survivors go through Miller-Rabin.
+const uint64_t FULL_SIEVE_LIMIT = 1 << 22;
+const uint64_t PREFILTER_LIMIT = 1 << 16;
+
+class SegmentSieve {
+public:
+    // Base primes are shared read-only by every thread's sieve, past FULL_SIEVE_LIMIT they only prefilter
+    explicit SegmentSieve(uint64_t yNumber, uint64_t sieveLimit = 0) {
+        baseLimit = baseLimitFor(yNumber, sieveLimit);
+
+        std::vector<char> composite(baseLimit + 1, 0);
+        for (uint64_t i = 2; i <= baseLimit; ++i) {
+            if (composite[i]) continue;
+            basePrimes.push_back(static_cast<uint32_t>(i));
+            for (uint64_t j = i * i; j <= baseLimit; j += i) {
+                composite[j] = 1;
+            }
+        }
+    }
+
+    // Largest base prime sieved with up to yNumber: sqrt(y), capped at sieveLimit if one is given
+    static uint64_t baseLimitFor(uint64_t yNumber, uint64_t sieveLimit) {
+        uint64_t root = integerSqrt(yNumber);
+        if (sieveLimit > 0) return std::min(root, sieveLimit);
+        return (root <= FULL_SIEVE_LIMIT) ? root : PREFILTER_LIMIT;
+    }
+
+    // Sieve [low, high] with the base primes, segment[k] is left true if low + k has no base prime factor.
+    // Returns how many multiples were crossed off.
+    uint64_t sieveSegment(uint64_t low, uint64_t high, std::vector<char>& segment) const {
+        uint64_t length = high - low + 1;
+        uint64_t crossedOff = 0;
+        std::fill(segment.begin(), segment.begin() + length, 1);
+
+        for (uint32_t p : basePrimes) {
+            uint64_t square = static_cast<uint64_t>(p) * p;
+            if (square > high) break;
+
+            // start crossing off at the first multiple of p inside the segment, but never below p*p
+            uint64_t first = (square >= low) ? square - low : (p - low % p) % p;
+            for (uint64_t j = first; j < length; j += p) {
+                segment[j] = 0;
+                ++crossedOff;
+            }
+        }
+
+        // 0 and 1 are not primes
+        for (uint64_t i = low; i <= std::min<uint64_t>(high, 1); ++i) {
+            segment[i - low] = 0;
+        }
+        return crossedOff;
+    }
+
+    // A segment survivor is prime if it is too small to hide two factors above baseLimit
+    bool isSurvivorPrime(uint64_t n) const {
+        if (n / (baseLimit + 1) < baseLimit + 1) return true;
+        return isPrime(n);
+    }
+
+private:
+    std::vector<uint32_t> basePrimes;
+    uint64_t baseLimit = 0;
+};
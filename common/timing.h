@@ -0,0 +1,83 @@
+/**
+ * Wall-clock helpers for the timestamps printed next to each prime and the run summary.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using Clock = std::chrono::system_clock;
+using TimePoint = Clock::time_point;
+
+// localtime_s only exists on Windows and localtime_r only on POSIX
+inline std::tm localTime(std::time_t timeStamp) {
+    std::tm timeInfo{};
+#ifdef _WIN32
+    localtime_s(&timeInfo, &timeStamp);
+#else
+    localtime_r(&timeStamp, &timeInfo);
+#endif
+    return timeInfo;
+}
+
+// Format the time as HH:MM:SS into timeBuffer and return the milliseconds part
+inline long long formatTimestamp(TimePoint time, char (&timeBuffer)[9]) {
+    std::tm timeInfo = localTime(Clock::to_time_t(time));
+    std::strftime(timeBuffer, sizeof(timeBuffer), "%H:%M:%S", &timeInfo);
+
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+}
+
+// Per-thread formatter that only calls localtime/strftime again once the second changes,
+// aligned so formatters of neighbouring threads never share a cache line
+class alignas(64) TimestampFormatter {
+public:
+    const char* format(TimePoint time, long long& millis) {
+        std::time_t second = Clock::to_time_t(time);
+        if (second != cachedSecond) {
+            std::tm timeInfo = localTime(second);
+            std::strftime(timeBuffer, sizeof(timeBuffer), "%H:%M:%S", &timeInfo);
+            cachedSecond = second;
+        }
+
+        millis = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+        return timeBuffer;
+    }
+
+private:
+    char timeBuffer[9] = {};
+    std::time_t cachedSecond = -1;
+};
+
+inline void printStartAndEnd(TimePoint start, TimePoint end) {
+    std::chrono::duration<double> elapsed_seconds = end - start;
+
+    char startBuffer[9], endBuffer[9];
+    long long start_ms = formatTimestamp(start, startBuffer);
+    long long end_ms = formatTimestamp(end, endBuffer);
+
+    // Print timestamps with milliseconds
+    std::cout << "Started computation at: " << startBuffer
+              << ":" << std::setfill('0') << std::setw(3) << start_ms
+              << std::endl;
+
+    std::cout << "Finished computation at: " << endBuffer
+              << ":" << std::setfill('0') << std::setw(3) << end_ms
+              << std::endl;
+
+    std::cout << "Elapsed time: "
+              << elapsed_seconds.count() << "s"
+              << std::endl;
+}
+
+inline void printIdleTimes(const std::vector<TimePoint>& threadFinishTimes, TimePoint end) {
+    // time each thread spent waiting for the slowest thread after running out of work
+    for (size_t i = 0; i < threadFinishTimes.size(); ++i) {
+        std::chrono::duration<double> idle_seconds = end - threadFinishTimes[i];
+        std::cout << "Thread ID: " << i << " | Idle time: " << idle_seconds.count() << "s" << std::endl;
+    }
+}
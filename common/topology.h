@@ -0,0 +1,258 @@
+/**
+ * CPU topology and cache sizes from Linux sysfs, used to pin workers and size the sieve.
+ *
+ * With --affinity=compact the workers fill one core after another, hyperthreads of a core next
+ * to each other and one NUMA node before the next. With --affinity=scatter they are spread over
+ * the nodes first and then over the physical cores, before any core gets a second worker.
+ * A worker pins itself before it allocates anything, so its segment and its result buffers are
+ * first touched, and therefore placed, on its own node.
+ *
+ * Segments default to the L1 data cache size, one byte per number, and dynamic chunks to the
+ * L2 size. Without sysfs (other systems, containers hiding it) 32 KB and 256 KB are assumed.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "config.h"
+#include "metrics.h"
+
+const char* const SYSFS_CPU = "/sys/devices/system/cpu/";
+
+// Bounds on the detected segment size, in numbers
+const uint64_t MIN_SEGMENT_SIZE = 16 * 1024;
+const uint64_t MAX_SEGMENT_SIZE = 1024 * 1024;
+
+// A dynamic run is split into at least this many chunks per thread, however large the L2 is
+const uint64_t MIN_CHUNKS_PER_THREAD = 8;
+
+struct LogicalCpu {
+    int cpu;
+    int package;
+    int core;
+    int node;
+};
+
+// Where a worker runs, cpu -1 if it is not pinned
+struct Placement {
+    int cpu = -1;
+    int node = -1;
+};
+
+struct CacheSizes {
+    uint64_t l1Data = 32 * 1024;
+    uint64_t l2 = 256 * 1024;
+};
+
+inline bool readSysfsValue(const std::string& path, std::string& value) {
+    std::ifstream file(path);
+    return static_cast<bool>(std::getline(file, value));
+}
+
+// Sizes such as "48K" or "2M" in bytes, 0 if unreadable
+inline uint64_t parseCacheSize(const std::string& value) {
+    size_t digits = 0;
+    while (digits < value.size() && value[digits] >= '0' && value[digits] <= '9') ++digits;
+    if (digits == 0) return 0;
+
+    uint64_t size = std::stoull(value.substr(0, digits));
+    char unit = (digits < value.size()) ? value[digits] : ' ';
+    if (unit == 'K') size <<= 10;
+    if (unit == 'M') size <<= 20;
+    return size;
+}
+
+inline CacheSizes detectCacheSizes() {
+    static const CacheSizes sizes = [] {
+        CacheSizes detected;
+        for (int index = 0; ; ++index) {
+            std::string dir = std::string(SYSFS_CPU) + "cpu0/cache/index" + std::to_string(index) + "/";
+            std::string level, type, size;
+            if (!readSysfsValue(dir + "level", level) || !readSysfsValue(dir + "type", type) ||
+                !readSysfsValue(dir + "size", size)) {
+                break;
+            }
+
+            uint64_t bytes = parseCacheSize(size);
+            if (bytes == 0) continue;
+            if (level == "1" && type == "Data") detected.l1Data = bytes;
+            if (level == "2" && type != "Instruction") detected.l2 = bytes;
+        }
+        return detected;
+    }();
+    return sizes;
+}
+
+// Numbers per sieve segment: the configured size, or one byte per number filling the L1 data cache
+inline uint64_t segmentSizeFor(const Config& config) {
+    if (config.segmentSize > 0) return config.segmentSize;
+    return std::clamp(detectCacheSizes().l1Data, MIN_SEGMENT_SIZE, MAX_SEGMENT_SIZE);
+}
+
+// Numbers per dynamic chunk: the configured size, or the L2 size in whole segments, made smaller
+// when the range would otherwise be split into too few chunks to balance
+inline uint64_t chunkSizeFor(const Config& config, uint64_t segmentSize) {
+    if (config.chunkSize > 0) return config.chunkSize;
+
+    uint64_t rangeSize = config.yNumber - config.startNumber + 1;
+    uint64_t balanced = rangeSize / (MIN_CHUNKS_PER_THREAD * std::max(config.xNumThreads, 1));
+    uint64_t chunk = std::min(detectCacheSizes().l2, balanced) / segmentSize * segmentSize;
+    return std::max(chunk, segmentSize);
+}
+
+// The CPUs this process may run on, with their core, package and NUMA node
+inline std::vector<LogicalCpu> readTopology() {
+    std::vector<LogicalCpu> cpus;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return cpus;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        std::string dir = std::string(SYSFS_CPU) + "cpu" + std::to_string(cpu) + "/";
+
+        LogicalCpu info{cpu, 0, cpu, 0};
+        std::string value;
+        if (readSysfsValue(dir + "topology/physical_package_id", value)) info.package = std::stoi(value);
+        if (readSysfsValue(dir + "topology/core_id", value)) info.core = std::stoi(value);
+
+        // the node shows up as a nodeN entry in the cpu's directory
+        if (DIR* entries = opendir(dir.c_str())) {
+            while (dirent* entry = readdir(entries)) {
+                std::string name = entry->d_name;
+                if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                    std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+                    info.node = std::stoi(name.substr(4));
+                }
+            }
+            closedir(entries);
+        }
+        cpus.push_back(info);
+    }
+#endif
+    return cpus;
+}
+
+// CPUs this process may run on, from its affinity mask where there is one
+inline int countAvailableCpus() {
+    size_t allowed = readTopology().size();
+    if (allowed > 0) return static_cast<int>(allowed);
+    return static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+}
+
+// Physical memory in bytes, lowered to the address space limit if there is one, 0 if unknown
+inline uint64_t usableMemory() {
+#ifdef __linux__
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || pageSize <= 0) return 0;
+    uint64_t bytes = static_cast<uint64_t>(pages) * static_cast<uint64_t>(pageSize);
+
+    rlimit limit;
+    if (getrlimit(RLIMIT_AS, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        bytes = std::min<uint64_t>(bytes, limit.rlim_cur);
+    }
+    return bytes;
+#else
+    return 0;
+#endif
+}
+
+// The CPU each of numThreads workers is pinned to under the given policy
+inline std::vector<Placement> placeThreads(AffinityMode mode, int numThreads) {
+    std::vector<Placement> placements(numThreads);
+    if (mode == AffinityMode::None) return placements;
+
+    std::vector<LogicalCpu> cpus = readTopology();
+    if (cpus.empty()) return placements;
+
+    // rank hyperthreads of the same core 0, 1, ... in cpu order
+    std::vector<int> sibling(cpus.size(), 0);
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            if (cpus[j].package == cpus[i].package && cpus[j].core == cpus[i].core) ++sibling[i];
+        }
+    }
+
+    std::vector<size_t> order(cpus.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+
+    if (mode == AffinityMode::Compact) {
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            const LogicalCpu& x = cpus[a];
+            const LogicalCpu& y = cpus[b];
+            if (x.node != y.node) return x.node < y.node;
+            if (x.package != y.package) return x.package < y.package;
+            if (x.core != y.core) return x.core < y.core;
+            return x.cpu < y.cpu;
+        });
+    } else {
+        // the k-th core of every node before the (k+1)-th core of any, second hyperthreads last
+        std::vector<int> rankInNode(cpus.size(), 0);
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            std::set<std::pair<int, int>> coresBefore;
+            for (size_t j = 0; j < cpus.size(); ++j) {
+                if (cpus[j].node == cpus[i].node && sibling[j] == 0 &&
+                    std::make_pair(cpus[j].package, cpus[j].core) < std::make_pair(cpus[i].package, cpus[i].core)) {
+                    coresBefore.insert({cpus[j].package, cpus[j].core});
+                }
+            }
+            rankInNode[i] = static_cast<int>(coresBefore.size());
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            if (sibling[a] != sibling[b]) return sibling[a] < sibling[b];
+            if (rankInNode[a] != rankInNode[b]) return rankInNode[a] < rankInNode[b];
+            if (cpus[a].node != cpus[b].node) return cpus[a].node < cpus[b].node;
+            return cpus[a].cpu < cpus[b].cpu;
+        });
+    }
+
+    for (int i = 0; i < numThreads; ++i) {
+        const LogicalCpu& cpu = cpus[order[i % order.size()]];
+        placements[i] = {cpu.cpu, cpu.node};
+    }
+    return placements;
+}
+
+// Pin the calling thread to its CPU, if it has one
+inline void pinCurrentThread(const Placement& placement) {
+#ifdef __linux__
+    if (placement.cpu < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(placement.cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)placement;
+#endif
+}
+
+// Pin a worker and record where it runs
+inline void pinWorker(const Placement& placement, ThreadMetrics& metrics) {
+    pinCurrentThread(placement);
+    metrics.cpu = placement.cpu;
+    metrics.node = placement.node;
+}
+
+inline int countNodes(const std::vector<Placement>& placements) {
+    std::set<int> nodes;
+    for (const auto& placement : placements) {
+        if (placement.cpu >= 0) nodes.insert(placement.node);
+    }
+    return static_cast<int>(nodes.size());
+}
@@ -0,0 +1,215 @@
+/**
+ * Timeline tracing with --trace=PATH: each thread records what it does into rings of its own, as
+ * raw steady_clock ticks and a couple of integers, and nothing is formatted during the run. Once
+ * the run is over the rings are written out as Chrome trace-event JSON, which chrome://tracing
+ * and ui.perfetto.dev show as one row per thread, so gaps in the scheduling stand out.
+ *
+ * Recorded are each worker's lifetime, the main thread spawning and joining the workers, every
+ * chunk or static slice from claim to done, every sieved segment, waits for a lock, for the
+ * output or for an empty job queue, and the primes found. The primes go into a ring of their
+ * own, so their sheer number cannot push the scheduling events out. A full ring overwrites its
+ * oldest entries, and the export reports how many were lost.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+enum class TraceKind : uint8_t { Thread, Spawn, Join, Chunk, Slice, Segment, LockWait, OutputWait, Idle, Commit };
+
+// Name of each kind in the timeline, and of its two arguments, nullptr where unused
+struct TraceKindInfo {
+    const char* name;
+    const char* first;
+    const char* second;
+};
+
+const TraceKindInfo TRACE_KINDS[] = {
+    {"thread", nullptr, nullptr},
+    {"spawn", "thread", nullptr},
+    {"join", nullptr, nullptr},
+    {"chunk", "start", "end"},
+    {"slice", "start", "end"},
+    {"segment", "start", "primes"},
+    {"lock wait", nullptr, nullptr},
+    {"output wait", "start", nullptr},
+    {"idle", nullptr, nullptr},
+    {"commit", "batches", nullptr},
+};
+
+// Trace timestamps are steady_clock nanoseconds
+inline int64_t traceTicks(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+inline int64_t traceNow() {
+    return traceTicks(std::chrono::steady_clock::now());
+}
+
+struct TraceEvent {
+    int64_t begin;
+    int64_t end;
+    uint64_t first;
+    uint64_t second;
+    TraceKind kind;
+};
+
+struct TracePrime {
+    int64_t found;
+    uint64_t prime;
+};
+
+// Keeps the last capacity entries pushed, rounded up to a power of two
+template <class Entry>
+class TraceRing {
+public:
+    explicit TraceRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+    }
+
+    void push(const Entry& entry) { slots[pushed++ & (slots.size() - 1)] = entry; }
+
+    size_t capacity() const { return slots.size(); }
+
+    uint64_t dropped() const { return (pushed > slots.size()) ? pushed - slots.size() : 0; }
+
+    // Oldest first
+    template <class Visit>
+    void forEach(Visit visit) const {
+        for (uint64_t i = dropped(); i < pushed; ++i) visit(slots[i & (slots.size() - 1)]);
+    }
+
+private:
+    std::vector<Entry> slots;
+    uint64_t pushed = 0;
+};
+
+// Only ever written by its own thread, and read once every thread has stopped
+class alignas(64) ThreadTrace {
+public:
+    explicit ThreadTrace(size_t capacity) : events(capacity), primes(capacity) {}
+
+    // Something that went on from begin until now
+    void span(TraceKind kind, int64_t begin, uint64_t first = 0, uint64_t second = 0) {
+        events.push({begin, traceNow(), first, second, kind});
+    }
+
+    void instant(TraceKind kind, uint64_t first = 0) {
+        int64_t now = traceNow();
+        events.push({now, now, first, 0, kind});
+    }
+
+    void prime(int64_t found, uint64_t prime) { primes.push({found, prime}); }
+
+private:
+    friend class RunTrace;
+
+    TraceRing<TraceEvent> events;
+    TraceRing<TracePrime> primes;
+};
+
+class RunTrace {
+public:
+    // A trace per worker, and one for the thread running the search
+    explicit RunTrace(const Config& config) : origin(traceNow()) {
+        for (int i = 0; i <= config.xNumThreads; ++i) {
+            threads.push_back(std::make_unique<ThreadTrace>(config.traceEvents));
+        }
+    }
+
+    ThreadTrace& thread(int id) { return *threads[id]; }
+
+    ThreadTrace& main() { return *threads.back(); }
+
+    // Write the events of every thread as Chrome trace-event JSON, timestamps in microseconds
+    bool write(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Error: Could not write the trace to " << path << "!" << std::endl;
+            return false;
+        }
+
+        int mainId = static_cast<int>(threads.size()) - 1;
+        out << "{\"traceEvents\": [\n"
+            << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"primesearch\"}}";
+        for (int id = 0; id <= mainId; ++id) {
+            std::string name = (id == mainId) ? "main" : "Thread ID: " + std::to_string(id);
+            out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << id
+                << ", \"args\": {\"name\": \"" << name << "\"}}"
+                << ",\n{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << id
+                << ", \"args\": {\"sort_index\": " << (id == mainId ? -1 : id) << "}}";
+        }
+
+        uint64_t droppedEvents = 0, droppedPrimes = 0;
+        char line[256];
+        for (int id = 0; id <= mainId; ++id) {
+            const ThreadTrace& trace = *threads[id];
+            droppedEvents += trace.events.dropped();
+            droppedPrimes += trace.primes.dropped();
+
+            trace.events.forEach([&](const TraceEvent& event) {
+                const TraceKindInfo& info = TRACE_KINDS[static_cast<int>(event.kind)];
+                int length = (event.begin == event.end)
+                    ? std::snprintf(line, sizeof(line), ",\n{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, "
+                                    "\"tid\": %d, \"ts\": %.3f", info.name, id, micros(event.begin))
+                    : std::snprintf(line, sizeof(line), ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+                                    "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f", info.name, id,
+                                    micros(event.begin), (event.end - event.begin) / 1000.0);
+                out.write(line, length);
+
+                out << ", \"args\": {";
+                if (info.first != nullptr) out << "\"" << info.first << "\": " << event.first;
+                if (info.second != nullptr) out << ", \"" << info.second << "\": " << event.second;
+                out << "}}";
+            });
+
+            trace.primes.forEach([&](const TracePrime& prime) {
+                int length = std::snprintf(line, sizeof(line), ",\n{\"name\": \"prime\", \"ph\": \"i\", \"s\": \"t\", "
+                                           "\"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"args\": {\"prime\": %llu}}",
+                                           id, micros(prime.found), static_cast<unsigned long long>(prime.prime));
+                out.write(line, length);
+            });
+        }
+
+        out << "\n],\n\"displayTimeUnit\": \"ns\",\n\"otherData\": {\"droppedEvents\": " << droppedEvents
+            << ", \"droppedPrimes\": " << droppedPrimes << "}}\n";
+        out.flush();
+        if (!out) {
+            std::cerr << "Error: Could not write the trace to " << path << "!" << std::endl;
+            return false;
+        }
+
+        if (droppedEvents + droppedPrimes > 0) {
+            std::cerr << "Note: the trace kept the last " << threads.front()->events.capacity()
+                      << " events and primes of each thread, "
+                      << "raise trace_events to keep more" << std::endl;
+        }
+        return true;
+    }
+
+private:
+    double micros(int64_t tick) const { return (tick - origin) / 1000.0; }
+
+    int64_t origin;
+    std::vector<std::unique_ptr<ThreadTrace>> threads;
+};
+
+// The calling worker's trace, nullptr when the run is not traced
+inline ThreadTrace* threadTrace(const Config& config, int id) {
+    return (config.trace != nullptr) ? &config.trace->thread(id) : nullptr;
+}
+
+inline ThreadTrace* mainTrace(const Config& config) {
+    return (config.trace != nullptr) ? &config.trace->main() : nullptr;
+}
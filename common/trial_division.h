@@ -0,0 +1,137 @@
+/**
+ * Batch trial division for 32-bit numbers, shared by the variations and the benchmark.
+ *
+ * Instead of n % d, each divisor d gets a precomputed magic number c = ceil(2^64 / d), and
+ * n is divisible by d exactly when n * c (mod 2^64) <= c - 1 (Lemire, Kaser and Kurz,
+ * "Faster Remainder by Direct Computation"). That is one multiply and one compare, which
+ * vectorizes, so a number is tested against 4 (AVX2) or 8 (AVX-512) divisors at once.
+ * The widest kernel the CPU supports is picked at runtime, with a scalar fallback.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TRIAL_DIVISION_X86 1
+#endif
+
+// Divisors up to this cover every 32-bit n, since sqrt(2^32) = 2^16
+const uint32_t MAX_TRIAL_DIVISOR = 1 << 16;
+
+inline uint64_t divisibilityMagic(uint32_t divisor) {
+    return UINT64_MAX / divisor + 1;
+}
+
+// True if n is divisible by any of the divisors whose magic numbers are given
+inline bool divisibleByAnyScalar(uint32_t n, const uint64_t* magic, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (n * magic[i] <= magic[i] - 1) return true;
+    }
+    return false;
+}
+
+#ifdef TRIAL_DIVISION_X86
+__attribute__((target("avx2")))
+inline bool divisibleByAnyAvx2(uint32_t n, const uint64_t* magic, size_t count) {
+    const __m256i value = _mm256_set1_epi64x(n);
+    const __m256i signBit = _mm256_set1_epi64x(static_cast<long long>(1ULL << 63));
+    const __m256i one = _mm256_set1_epi64x(1);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(magic + i));
+
+        // low 64 bits of n * c, built from two 32x32 -> 64 bit products since AVX2 has no 64-bit mullo
+        __m256i low = _mm256_mul_epu32(value, c);
+        __m256i high = _mm256_mul_epu32(value, _mm256_srli_epi64(c, 32));
+        __m256i product = _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+
+        // unsigned product > c - 1, done as a signed compare with the sign bits flipped
+        __m256i notDivisible = _mm256_cmpgt_epi64(_mm256_xor_si256(product, signBit),
+                                                  _mm256_xor_si256(_mm256_sub_epi64(c, one), signBit));
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(notDivisible)) != 0xF) return true;
+    }
+    return divisibleByAnyScalar(n, magic + i, count - i);
+}
+
+__attribute__((target("avx512f,avx512dq")))
+inline bool divisibleByAnyAvx512(uint32_t n, const uint64_t* magic, size_t count) {
+    const __m512i value = _mm512_set1_epi64(n);
+    const __m512i one = _mm512_set1_epi64(1);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m512i c = _mm512_loadu_si512(magic + i);
+        __m512i product = _mm512_mullo_epi64(value, c);
+        if (_mm512_cmple_epu64_mask(product, _mm512_sub_epi64(c, one)) != 0) return true;
+    }
+    return divisibleByAnyScalar(n, magic + i, count - i);
+}
+#endif
+
+using DivisibleByAnyFunction = bool (*)(uint32_t, const uint64_t*, size_t);
+
+inline DivisibleByAnyFunction selectDivisibleByAny() {
+#ifdef TRIAL_DIVISION_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) return divisibleByAnyAvx512;
+    if (__builtin_cpu_supports("avx2")) return divisibleByAnyAvx2;
+#endif
+    return divisibleByAnyScalar;
+}
+
+inline const char* divisibleByAnyName() {
+    DivisibleByAnyFunction selected = selectDivisibleByAny();
+#ifdef TRIAL_DIVISION_X86
+    if (selected == divisibleByAnyAvx512) return "avx512";
+    if (selected == divisibleByAnyAvx2) return "avx2";
+#endif
+    return (selected == divisibleByAnyScalar) ? "scalar" : "unknown";
+}
+
+// Dispatches to the widest kernel the CPU supports, chosen on first use
+inline bool divisibleByAny(uint32_t n, const uint64_t* magic, size_t count) {
+    static const DivisibleByAnyFunction selected = selectDivisibleByAny();
+    return selected(n, magic, count);
+}
+
+// The primes up to MAX_TRIAL_DIVISOR and their magic numbers, in the same order
+struct PrimeMagicTable {
+    std::vector<uint32_t> primes;
+    std::vector<uint64_t> magic;
+};
+
+inline const PrimeMagicTable& primeMagicTable() {
+    static const PrimeMagicTable table = [] {
+        PrimeMagicTable result;
+        std::vector<char> composite(MAX_TRIAL_DIVISOR + 1, 0);
+        for (uint32_t i = 2; i <= MAX_TRIAL_DIVISOR; ++i) {
+            if (composite[i]) continue;
+            result.primes.push_back(i);
+            result.magic.push_back(divisibilityMagic(i));
+            for (uint64_t j = static_cast<uint64_t>(i) * i; j <= MAX_TRIAL_DIVISOR; j += i) {
+                composite[j] = 1;
+            }
+        }
+        return result;
+    }();
+    return table;
+}
+
+// Trial division of a 32-bit n by the primes up to sqrt(n)
+inline bool isPrimeTrialDivision(uint32_t n) {
+    if (n < 2) return false;
+
+    uint32_t root = static_cast<uint32_t>(std::sqrt(static_cast<double>(n)));
+    while (static_cast<uint64_t>(root) * root > n) --root;
+
+    const PrimeMagicTable& table = primeMagicTable();
+    size_t count = std::upper_bound(table.primes.begin(), table.primes.end(), root) - table.primes.begin();
+    return !divisibleByAny(n, table.magic.data(), count);
+}
@@ -0,0 +1,13 @@
+/**
+ * Any combination of print mode and division scheme, chosen on the command line:
+ * A1. --print=immediate, A2. --print=deferred or A3. --print=ordered, and
+ * B1. --division=straight or B2. --division=linear.
+ * --preset=variation1..4 selects the combination of the matching variation.
+ */
+
+#include "../common/engine.h"
+
+int main(int argc, char* argv[])
+{
+    return runMain(argc, argv, "variation1");
+}
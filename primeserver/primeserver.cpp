@@ -0,0 +1,30 @@
+/**
+ * Prime query daemon: keeps the base primes and recently sieved segments in memory and answers
+ * queries from other processes over a Unix domain socket, see common/query_protocol.h.
+ * Reads x (worker threads), socket and segment_cache from config.txt. Stops on SIGINT or SIGTERM.
+ */
+
+#include <csignal>
+
+#include "../common/config.h"
+#include "../common/query_server.h"
+
+QueryServer* runningServer = nullptr;
+
+void stopServer(int) {
+    if (runningServer != nullptr) runningServer->stop();
+}
+
+int main(int argc, char* argv[])
+{
+    Config config;
+    if (!parseCommandLine(argc, argv, config)) return 1;
+    if (!loadConfigFile(config)) return 1;
+
+    QueryServer server(config);
+    runningServer = &server;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+
+    return server.run() ? 0 : 1;
+}
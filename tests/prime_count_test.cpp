@@ -0,0 +1,72 @@
+/**
+ * Count-only mode against known values of pi(y), and against a plain sieve for y small enough to
+ * sieve, where every kind of leaf and the split of the sieve into blocks are exercised on a
+ * range of leaf bounds. Both with one thread and with several.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "prime_count.h"
+
+struct KnownCount {
+    uint64_t y;
+    uint64_t primes;
+};
+
+const KnownCount KNOWN_COUNTS[] = {
+    {10, 4},
+    {100, 25},
+    {1'000, 168},
+    {10'000, 1'229},
+    {100'000, 9'592},
+    {1'000'000, 78'498},
+    {10'000'000, 664'579},
+    {100'000'000, 5'761'455},
+    {1'000'000'000, 50'847'534},
+    {1ULL << 32, 203'280'221},
+    {10'000'000'000, 455'052'511},
+    {100'000'000'000, 4'118'054'813},
+    {1'000'000'000'000, 37'607'912'018},
+    {10'000'000'000'000, 346'065'536'839},
+};
+
+const uint64_t SIEVE_LIMIT = 20'000'000;
+const int RANDOM_COUNTS = 300;
+const int THREAD_COUNTS[] = {1, 3};
+
+bool expect(uint64_t y, int numThreads, uint64_t primes) {
+    uint64_t counted = countPrimesUpTo(y, numThreads);
+    if (counted == primes) return true;
+    std::cerr << "Error: pi(" << y << ") with " << numThreads << " threads came out as " << counted
+              << ", not " << primes << "!" << std::endl;
+    return false;
+}
+
+int main() {
+    bool passed = true;
+    for (const KnownCount& known : KNOWN_COUNTS) {
+        for (int numThreads : THREAD_COUNTS) passed = expect(known.y, numThreads, known.primes) && passed;
+    }
+
+    // pi up to SIEVE_LIMIT
+    std::vector<uint32_t> pi(SIEVE_LIMIT + 1, 0);
+    std::vector<bool> composite(SIEVE_LIMIT + 1, false);
+    for (uint64_t i = 2; i <= SIEVE_LIMIT; ++i) {
+        pi[i] = pi[i - 1];
+        if (composite[i]) continue;
+        ++pi[i];
+        for (uint64_t j = i * i; j <= SIEVE_LIMIT; j += i) composite[j] = true;
+    }
+
+    // around the plain sieve's limit, then up to SIEVE_LIMIT
+    std::mt19937_64 random(2024);
+    for (int k = 0; k < RANDOM_COUNTS; ++k) {
+        uint64_t y = (k < RANDOM_COUNTS / 3) ? SMALL_COUNT_LIMIT / 2 + random() % (4 * SMALL_COUNT_LIMIT)
+                                             : random() % (SIEVE_LIMIT + 1);
+        for (int numThreads : THREAD_COUNTS) passed = expect(y, numThreads, pi[y]) && passed;
+    }
+    return passed ? 0 : 1;
+}
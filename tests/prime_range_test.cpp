@@ -0,0 +1,99 @@
+/**
+ * The lazy range of prime_range.h against a plain sieve: whole ranges with one and several
+ * threads and small segments, so the read-ahead window wraps many times, and loops that break
+ * out early, which must stop the prefetcher's threads rather than wait for them to reach b.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <ranges>
+#include <vector>
+
+#include "prime_range.h"
+
+static_assert(std::ranges::input_range<PrimeRange>, "primes(a, b) works with the range algorithms");
+
+const uint64_t SIEVE_LIMIT = 2'000'000;
+// Far enough out that breaking early leaves almost all of the range unsieved
+const uint64_t FAR_START = 1'000'000'000'000;
+const uint64_t FAR_END = FAR_START + 1'000'000'000;
+
+struct RangeCase {
+    uint64_t a;
+    uint64_t b;
+    PrimeRangeOptions options;
+};
+
+std::vector<uint64_t> sievePrimes(uint64_t a, uint64_t b) {
+    std::vector<bool> composite(b + 1, false);
+    std::vector<uint64_t> primes;
+    for (uint64_t i = 2; i <= b; ++i) {
+        if (composite[i]) continue;
+        if (i >= a) primes.push_back(i);
+        for (uint64_t j = i * i; j <= b; j += i) composite[j] = true;
+    }
+    return primes;
+}
+
+bool expectRange(const RangeCase& test) {
+    std::vector<uint64_t> read;
+    for (uint64_t p : primes(test.a, test.b, test.options)) read.push_back(p);
+    if (read == sievePrimes(test.a, test.b)) return true;
+    std::cerr << "Error: primes(" << test.a << ", " << test.b << ") with " << test.options.threads
+              << " threads read " << read.size() << " primes that do not match the sieve!" << std::endl;
+    return false;
+}
+
+// The first count primes from FAR_START, then the range is dropped mid-way
+bool expectEarlyBreak(uint64_t count, int threads) {
+    std::vector<uint64_t> read;
+    for (uint64_t p : primes(FAR_START, FAR_END, {.threads = threads, .readAhead = 4})) {
+        read.push_back(p);
+        if (read.size() == count) break;
+    }
+
+    // each must be the next prime after the one before it
+    uint64_t previous = FAR_START - 1;
+    for (uint64_t p : read) {
+        uint64_t expected = previous + 1;
+        while (!isPrime(expected)) ++expected;
+        if (p != expected) {
+            std::cerr << "Error: read " << p << " after " << previous << ", not " << expected << "!" << std::endl;
+            return false;
+        }
+        previous = p;
+    }
+    if (read.size() == count) return true;
+    std::cerr << "Error: read " << read.size() << " primes from " << FAR_START << ", not " << count << "!" << std::endl;
+    return false;
+}
+
+int main() {
+    const RangeCase cases[] = {
+        {0, SIEVE_LIMIT, {.threads = 1}},
+        {0, SIEVE_LIMIT, {.threads = 3, .readAhead = 2, .segmentSize = 16 * 1024}},
+        {1'000'003, SIEVE_LIMIT, {.threads = 4, .readAhead = 5, .segmentSize = 16 * 1024}},
+        {2, 2, {.threads = 2}},
+        {24, 28, {.threads = 2}},
+        {100, 99, {.threads = 2}},
+    };
+
+    bool passed = true;
+    for (const RangeCase& test : cases) passed = expectRange(test) && passed;
+
+    for (int threads : {1, 4}) {
+        passed = expectEarlyBreak(10, threads) && passed;
+        passed = expectEarlyBreak(5'000, threads) && passed;
+    }
+
+    // an algorithm stopping at the first match leaves the range the same way
+    PrimeRange range = primes(FAR_START, FAR_END, {.threads = 2});
+    auto found = std::ranges::find_if(range, [](uint64_t p) { return p % 10 == 3; });
+    if (found == range.end() || *found % 10 != 3) {
+        std::cerr << "Error: find_if found no prime ending in 3 from " << FAR_START << "!" << std::endl;
+        passed = false;
+    }
+    return passed ? 0 : 1;
+}
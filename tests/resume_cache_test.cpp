@@ -0,0 +1,78 @@
+/**
+ * A run stopped part way and resumed with --cache skips the chunks its checkpoint covers. The
+ * cache it leaves behind must still hold every prime, since later runs read it without sieving.
+ *
+ * The stopped run is stood in for by a checkpoint of the first chunks, summarized by a search of
+ * just those. The resumed run and a cached rerun after it must both count every prime up to y.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "checkpoint.h"
+#include "config.h"
+#include "division_policies.h"
+#include "reduction_output.h"
+
+const uint64_t Y = 10'000'000;
+const uint64_t PRIMES_UP_TO_Y = 664579;
+const uint64_t CHUNK = 100'000;
+// Where the stopped run got to, at a chunk boundary
+const uint64_t STOPPED_AT = 40 * CHUNK;
+
+uint64_t countPrimes(const Config& config) {
+    ReductionOutput counter(config);
+    SearchReport report;
+    report.metrics.threads.resize(config.xNumThreads);
+    StraightDivision::search(config, counter, report);
+    return counter.total().count;
+}
+
+bool expect(const char* run, uint64_t counted) {
+    if (counted == PRIMES_UP_TO_Y) return true;
+    std::cerr << "Error: the " << run << " counted " << counted << " primes up to " << Y << ", not "
+              << PRIMES_UP_TO_Y << "!" << std::endl;
+    return false;
+}
+
+int main() {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "primesearch_resume_cache_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    Config config;
+    config.xNumThreads = 2;
+    config.yNumber = Y;
+    config.dynamicScheduling = true;
+    config.chunkSize = CHUNK;
+    config.outputFormat = OutputFormat::Reduce;
+
+    Config stopped = config;
+    stopped.yNumber = STOPPED_AT;
+    ReductionOutput stoppedCounter(stopped);
+    SearchReport stoppedReport;
+    stoppedReport.metrics.threads.resize(stopped.xNumThreads);
+    StraightDivision::search(stopped, stoppedCounter, stoppedReport);
+
+    auto checkpoint = std::make_shared<Checkpoint>();
+    checkpoint->startNumber = config.startNumber;
+    checkpoint->yNumber = Y;
+    checkpoint->chunkSize = CHUNK;
+    checkpoint->output = ReductionOutput::NAME;
+    checkpoint->ranges.push_back({config.startNumber, STOPPED_AT, stoppedCounter.total()});
+
+    Config resumed = config;
+    resumed.cachePath = (directory / "primes.cache").string();
+    resumed.resumeFrom = checkpoint;
+    bool passed = expect("resumed run", countPrimes(resumed));
+
+    Config cached = config;
+    cached.cachePath = resumed.cachePath;
+    passed = expect("cached rerun", countPrimes(cached)) && passed;
+
+    std::filesystem::remove_all(directory);
+    return passed ? 0 : 1;
+}